@@ -0,0 +1,58 @@
+/**
+ * @file Backend.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 生成バックエンド：共有ライブラリ版
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Backend.h"
+
+namespace StableDiffusion {
+#ifdef _WIN32
+	static constexpr auto kLibraryName = "stable-diffusion.dll";
+	static void* OpenLibrary(const std::string& path) { return LoadLibraryA(path.c_str()); }
+	static void* FindSymbol(void* module, const char* name) { return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(module), name)); }
+	static void CloseLibrary(void* module) { FreeLibrary(static_cast<HMODULE>(module)); }
+#else
+	static constexpr auto kLibraryName = "libstable-diffusion.so";
+	static void* OpenLibrary(const std::string& path) { return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL); }
+	static void* FindSymbol(void* module, const char* name) { return dlsym(module, name); }
+	static void CloseLibrary(void* module) { dlclose(module); }
+#endif
+
+#define BIND_FUNCTION(function) backend.function = reinterpret_cast<decltype(backend.function)>(FindSymbol(module, #function))
+
+	/// 共有ライブラリのバックエンド
+	/// @param backend 設定先
+	/// @param base_path ライブラリを探しに行くベースパス
+	/// @return ロード出来たらtrue
+	bool LoadLibraryBackend(Backend& backend, const std::string& base_path) {
+		// ライブラリのロード
+		auto path = base_path + kLibraryName;
+		print("LoadLibrary: %s", path.c_str());
+		auto module = OpenLibrary(path);
+		if (module == nullptr) {
+			print(LOG_ERROR, "LoadLibrary: error");
+			return false;
+		}
+
+		// 各関数のバインディング
+		backend = Backend{ .module = module };
+		BIND_FUNCTION(new_sd_ctx);
+		BIND_FUNCTION(free_sd_ctx);
+		BIND_FUNCTION(img2img);
+		BIND_FUNCTION(txt2img);
+		BIND_FUNCTION(get_num_physical_cores);
+		BIND_FUNCTION(sd_type_name);
+		BIND_FUNCTION(sd_set_log_callback);
+		BIND_FUNCTION(sd_set_progress_callback);
+		return true;
+	}
+
+	/// バックエンドの解放
+	void FreeBackend(Backend& backend) {
+		if (backend.module) CloseLibrary(backend.module);
+		backend = Backend{};
+	}
+}
@@ -0,0 +1,56 @@
+/**
+ * @file Backend.h
+ * @author 青猫 (AonekoSS)
+ * @brief 生成バックエンド（stable-diffusion.cppのAPIを関数ポインタで差し替えられるように）
+ */
+#pragma once
+
+#define SD_BUILD_SHARED_LIB
+#include "stable-diffusion.cpp/stable-diffusion.h"
+
+namespace StableDiffusion {
+	/// @brief 生成バックエンド
+	/// @note 共有ライブラリ（DLL/so）かスタブのどちらかで中身を埋める
+	struct Backend {
+		/// @brief 共有ライブラリのハンドル（スタブならnullptr）
+		void* module{};
+
+		// API各関数のポインタ
+#define DECL_FUNCTION(function) decltype(::function)* function{}
+
+		DECL_FUNCTION(new_sd_ctx);
+		DECL_FUNCTION(free_sd_ctx);
+		DECL_FUNCTION(img2img);
+		DECL_FUNCTION(txt2img);
+		DECL_FUNCTION(get_num_physical_cores);
+		DECL_FUNCTION(sd_type_name);
+		DECL_FUNCTION(sd_set_log_callback);
+		DECL_FUNCTION(sd_set_progress_callback);
+
+#undef DECL_FUNCTION
+
+		/// 生成の中断（次のステップで打ち切る）
+		/// @note stable-diffusion.cppのAPIには無いのでスタブだけ（DLLならnullptr）
+		void (*cancel)(){};
+
+		/// 使える状態か
+		explicit operator bool() const noexcept { return new_sd_ctx != nullptr; }
+	};
+
+	/// 共有ライブラリのバックエンド
+	/// @param backend 設定先
+	/// @param base_path ライブラリを探しに行くベースパス
+	/// @return ロード出来たらtrue
+	/// @note Windowsならstable-diffusion.dll、それ以外はlibstable-diffusion.so
+	extern bool LoadLibraryBackend(Backend& backend, const std::string& base_path);
+
+	/// スタブのバックエンド
+	/// @param backend 設定先
+	/// @param step_ms 1ステップ毎の待ち時間（ミリ秒）
+	/// @param load_ms コンテキスト作成（モデルのロード）の待ち時間（ミリ秒）
+	/// @note モデル無しで模様の画像を返す（ベンチマークやGPU無しの環境用）
+	extern void LoadStubBackend(Backend& backend, int step_ms, int load_ms);
+
+	/// バックエンドの解放
+	extern void FreeBackend(Backend& backend);
+}
@@ -0,0 +1,228 @@
+/**
+ * @file Config.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイルの監視と読み込み済みの設定
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "IniFile.h"
+#include "Config.h"
+#include "Logger.h"
+#include "Trace.h"
+
+namespace Config {
+	const StableDiffusion::Params* Snapshot::Find(const std::string& section) const {
+		for (size_t i = 0; i < sections.size(); ++i) {
+			if (sections[i] == section) return &params[i];
+		}
+		return nullptr;
+	}
+
+	// 公開中のスナップショット
+	// @note 古いものは最後の読み手が手放した時に解放される（読み直しの度に溜まらない）
+	static const auto emptySnapshot = std::make_shared<const Snapshot>();
+	static std::atomic<std::shared_ptr<const Snapshot>> currentSnapshot;
+
+	// 読み直しの排他
+	static std::mutex publishMutex;
+	static std::shared_ptr<const IniFile::Table> publishedTable;
+
+	// 監視スレッド
+	static std::string watchPath;
+	static std::string watchFileName;
+	static std::thread watchThread;
+	static std::atomic<bool> watchExit;
+#ifdef _WIN32
+	static HANDLE watchDirectory = INVALID_HANDLE_VALUE;
+	static HANDLE watchStopEvent;
+	static OVERLAPPED watchOverlapped;
+	alignas(DWORD) static char watchBuffer[4096];
+#else
+	static int watchFd = -1;
+#endif
+
+	std::shared_ptr<const Snapshot> Current() {
+		auto snapshot = currentSnapshot.load(std::memory_order_acquire);
+		return snapshot ? snapshot : emptySnapshot;
+	}
+
+	/// 読み直し
+	/// @return 新しいスナップショットを公開したらtrue（ファイルが変わっていなければ何もしない）
+	static bool Reload() {
+		std::lock_guard lock(publishMutex);
+		auto table = IniFile::Load(watchPath);
+		if (table == publishedTable) return false;
+		publishedTable = table;
+
+		// 書き換え途中のおかしな値（数字じゃない、範囲外）は前の設定のままにする
+		// @note 監視スレッドで例外が抜けるとホストごと落ちるので必ずここで止める
+		auto snapshot = std::make_shared<Snapshot>();
+		std::string section = "COMMON";
+		try {
+			snapshot->common = StableDiffusion::LoadParams(*table, section);
+			for (const auto& name : table->Sections()) {
+				if (name == "COMMON") continue;
+				section = name;
+				snapshot->sections.push_back(name);
+				snapshot->params.push_back(StableDiffusion::LoadParams(*table, name, snapshot->common));
+			}
+		} catch (const std::exception& e) {
+			print(LOG_ERROR, "config: bad value in [%s] (%s), keep previous settings", section.c_str(), e.what());
+			return false;
+		}
+		Logger::Configure(snapshot->common.log_level, snapshot->common.log_max_kb);
+		Trace::Configure(snapshot->common.trace);
+		currentSnapshot.store(std::move(snapshot), std::memory_order_release);
+		return true;
+	}
+
+	/// 設定ファイルが変わった時
+	static void OnChanged() {
+		// 保存途中で読まないように少し待つ（エディタによっては何回かに分けて書く）
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (!Reload()) return;
+
+		// どの設定からも使われなくなったモデルは捨てる
+		const auto snapshot = Current();
+		print("config: reloaded (%d settings)", static_cast<int>(snapshot->sections.size()));
+		auto params = snapshot->params;
+		params.push_back(snapshot->common);
+		StableDiffusion::RetainModels(params);
+	}
+
+#ifdef _WIN32
+	/// 監視の開始（ここから後の変更は次のGetOverlappedResultで受け取れる）
+	static bool OpenWatch(const std::string& directory) {
+		watchDirectory = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (watchDirectory == INVALID_HANDLE_VALUE) return false;
+		watchOverlapped = OVERLAPPED{};
+		watchOverlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		watchStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		return true;
+	}
+
+	/// 変更の受け取り待ちを積む
+	static bool RequestWatch() {
+		ResetEvent(watchOverlapped.hEvent);
+		return ReadDirectoryChangesW(watchDirectory, watchBuffer, sizeof(watchBuffer), FALSE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE, nullptr, &watchOverlapped, nullptr);
+	}
+
+	/// 監視の終了
+	static void CloseWatch() {
+		CloseHandle(watchOverlapped.hEvent);
+		CloseHandle(watchStopEvent);
+		CloseHandle(watchDirectory);
+		watchDirectory = INVALID_HANDLE_VALUE;
+	}
+
+	/// 監視スレッド（ReadDirectoryChangesW）
+	static void WatchWorker() {
+		const std::wstring wideName(watchFileName.begin(), watchFileName.end()); // ファイル名はASCIIだけ
+		while (!watchExit) {
+			HANDLE handles[] = { watchOverlapped.hEvent, watchStopEvent };
+			DWORD bytes = 0;
+			if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+				CancelIoEx(watchDirectory, &watchOverlapped);
+				GetOverlappedResult(watchDirectory, &watchOverlapped, &bytes, TRUE);
+				break;
+			}
+			if (!GetOverlappedResult(watchDirectory, &watchOverlapped, &bytes, FALSE)) break;
+
+			// 対象のファイルが変わったか（溢れた時は分からないので読み直す）
+			bool changed = bytes == 0;
+			for (DWORD offset = 0; offset < bytes;) {
+				auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(watchBuffer + offset);
+				const std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+				if (name.size() == wideName.size() && std::equal(name.begin(), name.end(), wideName.begin(),
+					[](wchar_t a, wchar_t b) { return towlower(a) == towlower(b); })) changed = true;
+				if (!info->NextEntryOffset) break;
+				offset += info->NextEntryOffset;
+			}
+
+			// 読み直してる間の変更も拾えるように先に次を積む
+			if (!RequestWatch()) break;
+			if (changed) OnChanged();
+		}
+	}
+#else
+	/// 監視の開始（ここから後の変更はreadで受け取れる）
+	static bool OpenWatch(const std::string& directory) {
+		watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (watchFd < 0) return false;
+		if (inotify_add_watch(watchFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+			close(watchFd);
+			watchFd = -1;
+			return false;
+		}
+		return true;
+	}
+
+	/// 変更の受け取り待ちを積む（inotifyは開いてる間ずっと溜まるので何もしない）
+	static bool RequestWatch() { return true; }
+
+	/// 監視の終了
+	static void CloseWatch() {
+		close(watchFd);
+		watchFd = -1;
+	}
+
+	/// 監視スレッド（inotify）
+	static void WatchWorker() {
+		alignas(inotify_event) char buffer[4096];
+		pollfd pfd{ watchFd, POLLIN, 0 };
+		while (!watchExit) {
+			// 停止を見るために時々起きる
+			if (poll(&pfd, 1, 200) <= 0) continue;
+
+			// 対象のファイルが変わったか（溢れた時は分からないので読み直す）
+			bool changed = false;
+			for (ssize_t length; (length = read(watchFd, buffer, sizeof(buffer))) > 0;) {
+				for (ssize_t offset = 0; offset < length;) {
+					auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+					if ((event->mask & IN_Q_OVERFLOW) || (event->len && watchFileName == event->name)) changed = true;
+					offset += sizeof(inotify_event) + event->len;
+				}
+			}
+			if (changed) OnChanged();
+		}
+	}
+#endif
+
+	void Start(const std::string& iniPath) {
+		if (watchThread.joinable()) return;
+		watchPath = iniPath;
+
+		// 監視を始めてから読む（間に書き換えられても取りこぼさないように）
+		const std::filesystem::path path(iniPath);
+		watchFileName = path.filename().string();
+		const bool opened = OpenWatch(path.parent_path().string());
+		const bool watching = opened && RequestWatch();
+		Reload();
+		if (!watching) {
+			if (opened) CloseWatch();
+			print("config: watch error (%s)", iniPath.c_str());
+			return;
+		}
+
+		watchExit = false;
+		watchThread = std::thread(WatchWorker);
+	}
+
+	void Stop() {
+		if (watchThread.joinable()) {
+			watchExit = true;
+#ifdef _WIN32
+			SetEvent(watchStopEvent);
+#endif
+			watchThread.join();
+			CloseWatch();
+		}
+
+		std::lock_guard lock(publishMutex);
+		currentSnapshot.store(nullptr, std::memory_order_release);
+		publishedTable.reset();
+	}
+}
@@ -0,0 +1,35 @@
+/**
+ * @file Config.h
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイルの監視と読み込み済みの設定
+ * @note 設定ファイルが書き換えられた時だけ裏で読み直して、新しいスナップショットに差し替える
+ */
+#pragma once
+
+#include "StableDiffusion.h"
+
+namespace Config {
+	/// 読み込み済みの設定（公開したら変更しない）
+	struct Snapshot {
+		std::vector<std::string> sections; // COMMON以外のセクション（ファイルに出てきた順）
+		StableDiffusion::Params common;    // COMMONの設定
+		std::vector<StableDiffusion::Params> params; // セクション毎の設定（COMMONを継承済み）
+
+		/// セクションの設定
+		/// @return 無ければnullptr
+		const StableDiffusion::Params* Find(const std::string& section) const;
+	};
+
+	/// 監視の開始（最初の読み込みはこの中で済ませる）
+	/// @param iniPath 設定ファイルのパス
+	/// @note 開始済みなら何もしない
+	extern void Start(const std::string& iniPath);
+
+	/// 監視の停止
+	extern void Stop();
+
+	/// 今の設定
+	/// @return 公開中のスナップショット（読み込む前や停止後は空のもの、nullptrにはならない）
+	/// @note 差し替えられても持っている間は残るので、使い終わるまで戻り値を保持すること
+	extern std::shared_ptr<const Snapshot> Current();
+}
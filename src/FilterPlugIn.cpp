@@ -7,12 +7,150 @@
 
 #include "SDPlugin.h"
 #include "FilterPlugIn.h"
+#include "Hash.h"
+
+// x64ならSSE4.1のカーネルを使う（CPUが対応してなければスカラー版）
+#if defined(_M_X64) || defined(__x86_64__)
+#define FILTERPLUGIN_SIMD
+#include <immintrin.h>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET
+#else
+#define SIMD_TARGET __attribute__((target("sse4.1")))
+#endif
+#endif
 
 namespace FilterPlugIn {
 	// バイト定義
 	typedef uint8_t byte_t;
 	typedef byte_t* pbyte_t;
 
+#ifdef FILTERPLUGIN_SIMD
+	/// @brief SSE4.1が使えるか
+	static bool HasSSE41() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+#else
+		return __builtin_cpu_supports("sse4.1");
+#endif
+	}
+	static const bool useSimd = HasSSE41();
+
+	/// @brief SIMD転送のレイアウト（4ピクセル単位）
+	struct SimdLayout {
+		__m128i shuffle;	// 転送元から転送先の並びへ
+		__m128i spread;		// ピクセル毎の1バイト（アルファ/選択）を転送先の各バイトへ
+		__m128i channels;	// 転送先でRGBのバイト（それ以外は書き換えない）
+		int srcStep, dstStep;
+		bool dense;			// 転送先がRGBだけ（3バイト）なら読まずに上書きできる
+		int cols;			// SIMDで処理する列数（4の倍数、残りはスカラーで）
+	};
+
+	/// @brief SIMD転送のレイアウト作成
+	/// @return 対応してるレイアウト（3か4バイトのRGB/RGBA系）ならtrue
+	static bool MakeSimdLayout(const Block& dst, const Block& src, Int cols, SimdLayout& layout) {
+		if (!useSimd) return false;
+		const auto valid = [](const Block& b) {
+			return (b.pixelBytes == 3 || b.pixelBytes == 4) &&
+				0 <= std::min({ b.r, b.g, b.b }) && std::max({ b.r, b.g, b.b }) < b.pixelBytes;
+		};
+		if (!valid(dst) || !valid(src)) return false;
+
+		alignas(16) int8_t shuffle[16], spread[16], channels[16];
+		std::fill(std::begin(shuffle), std::end(shuffle), int8_t(-1));
+		std::fill(std::begin(spread), std::end(spread), int8_t(-1));
+		std::fill(std::begin(channels), std::end(channels), int8_t(0));
+		for (int k = 0; k < 4; ++k) {
+			const auto d = k * dst.pixelBytes, s = k * src.pixelBytes;
+			shuffle[d + dst.r] = int8_t(s + src.r);
+			shuffle[d + dst.g] = int8_t(s + src.g);
+			shuffle[d + dst.b] = int8_t(s + src.b);
+			channels[d + dst.r] = channels[d + dst.g] = channels[d + dst.b] = int8_t(-1);
+			for (int c = 0; c < dst.pixelBytes; ++c) spread[d + c] = int8_t(k);
+		}
+		layout.shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffle));
+		layout.spread = _mm_load_si128(reinterpret_cast<const __m128i*>(spread));
+		layout.channels = _mm_load_si128(reinterpret_cast<const __m128i*>(channels));
+		layout.srcStep = 4 * src.pixelBytes;
+		layout.dstStep = 4 * dst.pixelBytes;
+		layout.dense = dst.pixelBytes == 3;
+
+		// 16バイト読み書きしても行をはみ出さない範囲
+		const int lookahead = std::max((16 + src.pixelBytes - 1) / src.pixelBytes, (16 + dst.pixelBytes - 1) / dst.pixelBytes);
+		layout.cols = cols >= lookahead ? ((cols - lookahead) / 4 + 1) * 4 : 0;
+		return layout.cols > 0;
+	}
+
+	/// @brief 4ピクセル分の1バイトチャンネル（アルファ/選択）を転送先の各バイトへ
+	SIMD_TARGET inline __m128i LoadSpread(const byte_t* p, const SimdLayout& layout) {
+		int32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return _mm_shuffle_epi8(_mm_cvtsi32_si128(v), layout.spread);
+	}
+
+	/// @brief 行転送（SIMD）
+	/// @note 3バイトの転送先は16バイト書くと次のピクセルまではみ出すけど、そこは後で（SIMDかスカラーで）上書きされる
+	SIMD_TARGET static void CopyRowSimd(pbyte_t pDst, const byte_t* pSrc, const SimdLayout& layout) {
+		if (layout.dense) {
+			for (int x = 0; x < layout.cols; x += 4, pDst += layout.dstStep, pSrc += layout.srcStep) {
+				const auto s = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc)), layout.shuffle);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), s);
+			}
+			return;
+		}
+		for (int x = 0; x < layout.cols; x += 4, pDst += layout.dstStep, pSrc += layout.srcStep) {
+			const auto s = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc)), layout.shuffle);
+			const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_blendv_epi8(d, s, layout.channels));
+		}
+	}
+
+	/// @brief 行転送（SIMD、アルファ付き）
+	SIMD_TARGET static void CopyRowSimd(pbyte_t pDst, const byte_t* pSrc, const byte_t* pAlp, const SimdLayout& layout) {
+		const auto zero = _mm_setzero_si128();
+		for (int x = 0; x < layout.cols; x += 4, pDst += layout.dstStep, pSrc += layout.srcStep, pAlp += 4) {
+			const auto s = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc)), layout.shuffle);
+			const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst));
+			const auto opaque = _mm_andnot_si128(_mm_cmpeq_epi8(LoadSpread(pAlp, layout), zero), layout.channels);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_blendv_epi8(d, s, opaque));
+		}
+	}
+
+	/// @brief 8チャンネル分のアルファブレンド（BlendFunctionと同じ結果）
+	/// @note 差の絶対値で掛けて (p + 1 + (p >> 8)) >> 8 が 0～65025 の範囲で p / 255 と一致、符号は後から戻す（0方向への切り捨て）
+	SIMD_TARGET inline __m128i Blend16(__m128i d, __m128i s, __m128i a) {
+		const auto diff = _mm_sub_epi16(s, d);
+		const auto p = _mm_mullo_epi16(_mm_abs_epi16(diff), a);
+		const auto q = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(p, _mm_set1_epi16(1)), _mm_srli_epi16(p, 8)), 8);
+		return _mm_add_epi16(d, _mm_sign_epi16(q, diff));
+	}
+
+	/// @brief 行転送（SIMD、アルファ＆選択マスク付き）
+	SIMD_TARGET static void BlendRowSimd(pbyte_t pDst, const byte_t* pSrc, const byte_t* pAlp, const byte_t* pSel, const SimdLayout& layout) {
+		const auto zero = _mm_setzero_si128();
+		for (int x = 0; x < layout.cols; x += 4, pDst += layout.dstStep, pSrc += layout.srcStep, pAlp += 4, pSel += 4) {
+			const auto s = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc)), layout.shuffle);
+			const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst));
+			const auto a = LoadSpread(pSel, layout);
+			const auto lo = Blend16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(a, zero));
+			const auto hi = Blend16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(a, zero));
+			const auto opaque = _mm_andnot_si128(_mm_cmpeq_epi8(LoadSpread(pAlp, layout), zero), layout.channels);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_blendv_epi8(d, _mm_packus_epi16(lo, hi), opaque));
+		}
+	}
+#else
+	// SIMD無し（常にスカラー版）
+	struct SimdLayout { int cols; };
+	static bool MakeSimdLayout(const Block&, const Block&, Int, SimdLayout& layout) { layout.cols = 0; return false; }
+	static void CopyRowSimd(pbyte_t, const byte_t*, const SimdLayout&) {}
+	static void CopyRowSimd(pbyte_t, const byte_t*, const byte_t*, const SimdLayout&) {}
+	static void BlendRowSimd(pbyte_t, const byte_t*, const byte_t*, const byte_t*, const SimdLayout&) {}
+#endif
+
 	/// @brief  矩形が空かどうか
 	bool isRectEmpty(const Rect& rect) {
 		return rect.left >= rect.right || rect.top >= rect.bottom;
@@ -62,10 +200,14 @@ namespace FilterPlugIn {
 		const auto rows = rect.bottom - rect.top;
 		pbyte_t pDstRow = static_cast<pbyte_t>(dst.address) + addressOffset(dst, rect);
 		pbyte_t pSrcRow = static_cast<pbyte_t>(src.address) + addressOffset(src, rect);
+		SimdLayout simd;
+		const bool simdRow = MakeSimdLayout(dst, src, cols, simd);
+		const int simdCols = simdRow ? simd.cols : 0;
 		for (int y = 0; y < rows; ++y) {
-			pbyte_t pSrc = pSrcRow;
-			pbyte_t pDst = pDstRow;
-			for (int x = 0; x < cols; ++x) {
+			if (simdRow) CopyRowSimd(pDstRow, pSrcRow, simd);
+			pbyte_t pSrc = pSrcRow + simdCols * srcPixelBytes;
+			pbyte_t pDst = pDstRow + simdCols * dstPixelBytes;
+			for (int x = simdCols; x < cols; ++x) {
 				pDst[dstR] = pSrc[srcR];
 				pDst[dstG] = pSrc[srcG];
 				pDst[dstB] = pSrc[srcB];
@@ -101,11 +243,15 @@ namespace FilterPlugIn {
 		pbyte_t pDstRow = static_cast<pbyte_t>(dst.address) + addressOffset(dst, rect);
 		pbyte_t pSrcRow = static_cast<pbyte_t>(src.address) + addressOffset(src, rect);
 		pbyte_t pAlpRow = static_cast<pbyte_t>(alpha.address) + addressOffset(alpha, rect);
+		SimdLayout simd;
+		const bool simdRow = alpPixelBytes == 1 && MakeSimdLayout(dst, src, cols, simd);
+		const int simdCols = simdRow ? simd.cols : 0;
 		for (int y = 0; y < rows; ++y) {
-			pbyte_t pSrc = pSrcRow;
-			pbyte_t pDst = pDstRow;
-			pbyte_t pAlp = pAlpRow;
-			for (int x = 0; x < cols; ++x) {
+			if (simdRow) CopyRowSimd(pDstRow, pSrcRow, pAlpRow, simd);
+			pbyte_t pSrc = pSrcRow + simdCols * srcPixelBytes;
+			pbyte_t pDst = pDstRow + simdCols * dstPixelBytes;
+			pbyte_t pAlp = pAlpRow + simdCols * alpPixelBytes;
+			for (int x = simdCols; x < cols; ++x) {
 				if (*pAlp > 0) {
 					pDst[dstR] = pSrc[srcR];
 					pDst[dstG] = pSrc[srcG];
@@ -155,12 +301,16 @@ namespace FilterPlugIn {
 		pbyte_t pSrcRow = static_cast<pbyte_t>(src.address) + addressOffset(src, rect);
 		pbyte_t pAlpRow = static_cast<pbyte_t>(alpha.address) + addressOffset(alpha, rect);
 		pbyte_t pSelRow = static_cast<pbyte_t>(select.address) + addressOffset(select, rect);
+		SimdLayout simd;
+		const bool simdRow = alpPixelBytes == 1 && selPixelBytes == 1 && MakeSimdLayout(dst, src, cols, simd);
+		const int simdCols = simdRow ? simd.cols : 0;
 		for (int y = 0; y < rows; ++y) {
-			pbyte_t pSrc = pSrcRow;
-			pbyte_t pDst = pDstRow;
-			pbyte_t pAlp = pAlpRow;
-			pbyte_t pSel = pSelRow;
-			for (int x = 0; x < cols; ++x) {
+			if (simdRow) BlendRowSimd(pDstRow, pSrcRow, pAlpRow, pSelRow, simd);
+			pbyte_t pSrc = pSrcRow + simdCols * srcPixelBytes;
+			pbyte_t pDst = pDstRow + simdCols * dstPixelBytes;
+			pbyte_t pAlp = pAlpRow + simdCols * alpPixelBytes;
+			pbyte_t pSel = pSelRow + simdCols * selPixelBytes;
+			for (int x = simdCols; x < cols; ++x) {
 				if (*pAlp > 0) {
 					uint16_t alpha = *pSel;
 					pDst[dstR] = BlendFunction(pDst[dstR], pSrc[srcR], alpha);
@@ -178,4 +328,138 @@ namespace FilterPlugIn {
 			pSelRow += selRowBytes;
 		}
 	}
+
+	/// @brief ブロック内容のハッシュ
+	/// @param block 対象のブロック
+	/// @param rect 対象の矩形（ブロックと重なる部分だけ）
+	/// @return 行毎にXXH64を繋いだハッシュ（重なりが無ければ0）
+	uint64_t HashBlock(const Block& block, const Rect& rect) {
+		const auto target = intersectRects(block.rect, rect);
+		if (isRectEmpty(target)) return 0;
+
+		const size_t rowBytes = static_cast<size_t>(target.right - target.left) * block.pixelBytes;
+		const auto rows = target.bottom - target.top;
+		pbyte_t pRow = static_cast<pbyte_t>(block.address) + addressOffset(block, target);
+		uint64_t hash = Hash::Bytes(&target, sizeof(target));
+		for (int y = 0; y < rows; ++y) {
+			hash = Hash::Bytes(pRow, rowBytes, hash);
+			pRow += block.rowBytes;
+		}
+		return hash;
+	}
+
+	/// @brief マスクの範囲
+	/// @param block 対象のブロック（選択範囲）
+	/// @param rect 対象の矩形（ブロックと重なる部分だけ）
+	/// @return 0以外のピクセルを囲む最小の矩形（無ければ空）
+	/// @note ブロックの一部だけ見るので、ホストのブロック（needOffset無し）でもブロックの矩形からのオフセットを足す
+	Rect MaskBounds(const Block& block, const Rect& rect) {
+		const auto target = intersectRects(block.rect, rect);
+		if (isRectEmpty(target)) return { 0, 0, 0, 0 };
+
+		const auto pixelBytes = block.pixelBytes;
+		const auto cols = target.right - target.left;
+		const auto rows = target.bottom - target.top;
+		Rect bounds = { target.right, target.bottom, target.left, target.top };
+		const auto offset = (target.top - block.rect.top) * block.rowBytes + (target.left - block.rect.left) * pixelBytes;
+		const byte_t* pRow = static_cast<const byte_t*>(block.address) + offset;
+		for (int y = 0; y < rows; ++y, pRow += block.rowBytes) {
+			// 行の両端から探す（中は見なくていい）
+			int left = 0;
+			while (left < cols && !pRow[left * pixelBytes]) ++left;
+			if (left == cols) continue;
+			int right = cols;
+			while (!pRow[(right - 1) * pixelBytes]) --right;
+			bounds.left = std::min(bounds.left, target.left + left);
+			bounds.right = std::max(bounds.right, target.left + right);
+			bounds.top = std::min(bounds.top, target.top + y);
+			bounds.bottom = target.top + y + 1;
+		}
+		return isRectEmpty(bounds) ? Rect{ 0, 0, 0, 0 } : bounds;
+	}
+
+	// 並列処理のワーカー（最初の呼び出しで論理コア数-1本立てて、TerminateParallelForまで使い回す）
+	struct ParallelTask {
+		const std::function<void(size_t)>* func;
+		size_t count;
+		std::atomic<size_t> next;
+	};
+	static std::mutex parallelCallMutex; // ParallelFor同士の排他（ワーカーは一組だけ）
+	static std::mutex parallelMutex;
+	static std::condition_variable parallelWake, parallelDone;
+	static std::vector<std::thread> parallelThreads;
+	static ParallelTask* parallelTask; // 配っている処理（呼び出し側が自分の分を終えたらnullptrに戻す）
+	static uint64_t parallelGeneration;
+	static size_t parallelBusy; // 処理中のワーカー数
+	static bool parallelExit;
+	static thread_local bool parallelInside; // 並列処理の中（入れ子は呼び出しスレッドでそのまま処理する）
+
+	/// 残りを取り合って処理
+	static void RunParallelTask(ParallelTask& task) {
+		for (size_t i; (i = task.next++) < task.count;) (*task.func)(i);
+	}
+
+	/// ワーカースレッド
+	static void ParallelWorker() {
+		parallelInside = true;
+		uint64_t seen = 0;
+		std::unique_lock lock(parallelMutex);
+		while (true) {
+			parallelWake.wait(lock, [&] { return parallelExit || (parallelTask && parallelGeneration != seen); });
+			if (parallelExit) return;
+			seen = parallelGeneration;
+			auto& task = *parallelTask;
+			++parallelBusy;
+			lock.unlock();
+			RunParallelTask(task);
+			lock.lock();
+			if (--parallelBusy == 0) parallelDone.notify_all();
+		}
+	}
+
+	/// @brief 並列処理
+	/// @param count 処理の数
+	/// @param func 処理（インデックスを受け取る、別スレッドから呼ばれる）
+	/// @note 呼び出しスレッドも加わって残りを取り合う（1個か入れ子なら呼び出しスレッドでそのまま）
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func) {
+		const size_t threads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+		if (threads <= 1 || parallelInside) {
+			for (size_t i = 0; i < count; ++i) func(i);
+			return;
+		}
+
+		std::lock_guard call(parallelCallMutex);
+		ParallelTask task{ &func, count, 0 };
+		{
+			std::lock_guard lock(parallelMutex);
+			if (parallelThreads.empty()) {
+				const unsigned workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+				for (unsigned t = 0; t < workers; ++t) parallelThreads.emplace_back(ParallelWorker);
+			}
+			parallelTask = &task;
+			++parallelGeneration;
+		}
+		parallelWake.notify_all();
+
+		parallelInside = true;
+		RunParallelTask(task);
+		parallelInside = false;
+
+		// これ以上ワーカーに拾わせずに、拾った分が終わるのを待つ
+		std::unique_lock lock(parallelMutex);
+		parallelTask = nullptr;
+		parallelDone.wait(lock, [] { return parallelBusy == 0; });
+	}
+
+	void TerminateParallelFor() {
+		std::lock_guard call(parallelCallMutex);
+		{
+			std::lock_guard lock(parallelMutex);
+			parallelExit = true;
+		}
+		parallelWake.notify_all();
+		for (auto& thread : parallelThreads) thread.join();
+		parallelThreads.clear();
+		parallelExit = false;
+	}
 }
@@ -277,6 +277,19 @@ namespace FilterPlugIn {
 	extern void Transfer(const Block& dst, const Block& src, const Block& alpha);
 	extern void Transfer(const Block& dst, const Block& src, const Block& alpha, const Block& select);
 
+	// ブロック内容のハッシュ（rectと重なる部分だけ）
+	extern uint64_t HashBlock(const Block& block, const Rect& rect);
+
+	// マスクの範囲（0以外のピクセルを囲む最小の矩形、無ければ空）
+	extern Rect MaskBounds(const Block& block, const Rect& rect);
+
+	// 並列処理（ブロック転送用、ホストのAPIはfuncの中で呼ばないこと）
+	// @note ワーカーは最初の呼び出しで立てて使い回す
+	extern void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	// 並列処理のワーカーの停止（次のParallelForでまた立てる）
+	extern void TerminateParallelFor();
+
 	/// オブジェクトベース（releaseProcで解放するタイプのやつ用）
 	template < class OBJECT, class SERVICE >
 	class ObjectBase {
@@ -389,6 +402,11 @@ namespace FilterPlugIn {
 			}
 		};
 
+		// 選択アイテムの取得（後から選択肢を足す用）
+		auto enumerationItem(int key) const {
+			return EnumerationItem(server(), *service2(), *this, key);
+		}
+
 		// アイテム追加：真偽
 		auto addBooleanItem(int key, String name, bool def) const {
 			auto pservice = service();
@@ -422,6 +440,8 @@ namespace FilterPlugIn {
 			auto pservice = service2();
 			pservice->setStringMaxLengthProc(*this, key, size);
 		}
+		// 値を保存するか（表示専用のアイテムは保存しない）
+		auto setStoreValue(int key, bool store) const { service2()->setItemStoreValueProc(*this, key, store); }
 
 		auto setBoolean(int key, bool val) const { service()->setBooleanValueProc(*this, key, val); }
 		auto setInteger(int key, int val) const { service()->setIntegerValueProc(*this, key, val); }
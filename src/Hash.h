@@ -0,0 +1,72 @@
+/**
+ * @file Hash.h
+ * @author 青猫 (AonekoSS)
+ * @brief ハッシュ関数（キャッシュのキー用）
+ */
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace Hash {
+	namespace detail {
+		constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+		constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+		constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+		constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+		constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+		inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+		inline uint64_t read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+		inline uint32_t read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+		inline uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; }
+		inline uint64_t merge(uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * P1 + P4; }
+	}
+
+	/// バイト列のハッシュ（XXH64）
+	/// @note 4レーン並列で回るのでメモリ帯域近くまで出る
+	inline uint64_t Bytes(const void* data, size_t size, uint64_t seed = 0) {
+		using namespace detail;
+		auto p = static_cast<const uint8_t*>(data);
+		const auto end = p + size;
+		uint64_t h;
+		if (size >= 32) {
+			uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+			const auto limit = end - 32;
+			do {
+				v1 = round(v1, read64(p));
+				v2 = round(v2, read64(p + 8));
+				v3 = round(v3, read64(p + 16));
+				v4 = round(v4, read64(p + 24));
+				p += 32;
+			} while (p <= limit);
+			h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+			h = merge(h, v1);
+			h = merge(h, v2);
+			h = merge(h, v3);
+			h = merge(h, v4);
+		} else {
+			h = seed + P5;
+		}
+		h += size;
+		for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+		if (p + 4 <= end) { h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3; p += 4; }
+		for (; p < end; ++p) h = rotl(h ^ (*p * P5), 11) * P1;
+		h ^= h >> 33; h *= P2;
+		h ^= h >> 29; h *= P3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	/// 値を順番に混ぜていくハッシュ
+	class Hasher {
+		uint64_t value_;
+	public:
+		constexpr explicit Hasher(uint64_t seed = 0) noexcept : value_{ seed } {}
+		template <class T> requires std::is_trivially_copyable_v<T>
+		Hasher& operator()(const T& val) { value_ = Bytes(&val, sizeof(val), value_); return *this; }
+		Hasher& operator()(const std::string& val) { value_ = Bytes(val.data(), val.size(), value_ ^ val.size()); return *this; }
+		constexpr uint64_t value() const noexcept { return value_; }
+	};
+}
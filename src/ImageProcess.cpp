@@ -0,0 +1,484 @@
+/**
+ * @file ImageProcess.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 画像処理（リサイズなど）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "ImageProcess.h"
+
+// x64ならSSE2のカーネルを使う（x64は必ずSSE2があるので判定はいらない）
+#if defined(_M_X64) || defined(__x86_64__)
+#define IMAGEPROCESS_SIMD
+#include <emmintrin.h>
+#endif
+
+namespace StableDiffusion {
+	constexpr float kPi = 3.14159265358979f;
+
+	/// フィルタの半径
+	static float FilterRadius(ResizeFilter filter) {
+		return filter == LANCZOS ? 3.0f : 2.0f;
+	}
+
+	/// フィルタの重み
+	static float FilterWeight(ResizeFilter filter, float x) {
+		x = std::abs(x);
+		if (filter == LANCZOS) {
+			if (x < 1e-6f) return 1.0f;
+			if (x >= 3.0f) return 0.0f;
+			const float px = kPi * x;
+			return 3.0f * std::sin(px) * std::sin(px / 3.0f) / (px * px);
+		}
+		// Catmull-Rom（a = -0.5）
+		if (x < 1.0f) return (1.5f * x - 2.5f) * x * x + 1.0f;
+		if (x < 2.0f) return ((-0.5f * x + 2.5f) * x - 4.0f) * x + 2.0f;
+		return 0.0f;
+	}
+
+	/// @brief 1次元の重みテーブル（出力1画素毎に入力の開始位置と重み）
+	struct Taps {
+		int count;                  // 1画素あたりのタップ数
+		std::vector<int> start;     // 出力画素毎の入力開始位置
+		std::vector<float> weights; // 出力画素毎にcount個
+	};
+
+	/// 重みテーブルの作成（端はクランプして重みを寄せる）
+	static Taps MakeTaps(int srcLength, int dstLength, ResizeFilter filter) {
+		const float scale = static_cast<float>(srcLength) / dstLength;
+		const float support = FilterRadius(filter) * std::max(scale, 1.0f);
+		const float invStretch = 1.0f / std::max(scale, 1.0f);
+
+		Taps taps;
+		taps.count = std::min(static_cast<int>(std::ceil(support)) * 2 + 1, srcLength);
+		taps.start.resize(dstLength);
+		taps.weights.assign(static_cast<size_t>(dstLength) * taps.count, 0.0f);
+		for (int i = 0; i < dstLength; ++i) {
+			const float center = (i + 0.5f) * scale - 0.5f;
+			const int start = std::clamp(static_cast<int>(std::floor(center - support)) + 1, 0, srcLength - taps.count);
+			taps.start[i] = start;
+
+			auto weights = &taps.weights[static_cast<size_t>(i) * taps.count];
+			const int first = static_cast<int>(std::floor(center - support)) + 1;
+			const int last = static_cast<int>(std::ceil(center + support)) - 1;
+			float total = 0.0f;
+			for (int j = first; j <= last; ++j) {
+				const float w = FilterWeight(filter, (j - center) * invStretch);
+				const int k = std::clamp(j, start, start + taps.count - 1) - start;
+				weights[k] += w;
+				total += w;
+			}
+			if (total != 0.0f) {
+				for (int k = 0; k < taps.count; ++k) weights[k] /= total;
+			}
+		}
+		return taps;
+	}
+
+	/// 行を帯に分けて並列処理
+	/// @param func (開始行, 終了行) を受け取る関数（別スレッドから呼ばれる）
+	/// @param bandRows 1つの帯の行数
+	template <class FUNC>
+	static void ForEachBand(int height, FUNC func, int bandRows = 16) {
+		const int bands = (height + bandRows - 1) / bandRows;
+		FilterPlugIn::ParallelFor(bands, [&](size_t i) {
+			const int y0 = static_cast<int>(i) * bandRows;
+			func(y0, std::min(y0 + bandRows, height));
+		});
+	}
+
+	/// チャンネル数を定数にして呼ぶ（よく使う数ならループがベクトル化される）
+	/// @param func チャンネル数（std::integral_constantかint）を受け取る関数
+	template <class FUNC>
+	static void WithChannel(int channel, FUNC func) {
+		switch (channel) {
+		case 1: func(std::integral_constant<int, 1>{}); break;
+		case 3: func(std::integral_constant<int, 3>{}); break;
+		case 4: func(std::integral_constant<int, 4>{}); break;
+		default: func(channel); break;
+		}
+	}
+
+	/// 横方向の積和（1行分）
+	/// @param source 入力行（RGB＋未使用の4つのfloat）
+	/// @param row 書き込み先（RGBの3つのfloat）
+	static void HorizontalRow(const Taps& taps, const float* source, int width, float* row) {
+		for (int x = 0; x < width; ++x) {
+			auto s = source + static_cast<size_t>(taps.start[x]) * 4;
+			auto w = &taps.weights[static_cast<size_t>(x) * taps.count];
+#ifdef IMAGEPROCESS_SIMD
+			auto sum = _mm_setzero_ps();
+			for (int k = 0; k < taps.count; ++k, s += 4) sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(s), _mm_set1_ps(w[k])));
+			_mm_storel_pi(reinterpret_cast<__m64*>(row + x * 3), sum);
+			_mm_store_ss(row + x * 3 + 2, _mm_movehl_ps(sum, sum));
+#else
+			float r = 0.0f, g = 0.0f, b = 0.0f;
+			for (int k = 0; k < taps.count; ++k, s += 4) {
+				r += s[0] * w[k];
+				g += s[1] * w[k];
+				b += s[2] * w[k];
+			}
+			row[x * 3 + 0] = r;
+			row[x * 3 + 1] = g;
+			row[x * 3 + 2] = b;
+#endif
+		}
+	}
+
+	/// リサイズ
+	/// @note 横方向は行毎にfloatの行バッファへ（必要な行だけリングで保持）、縦方向は行バッファの連続領域の積和
+	/// @note 出力を帯に分けて並列に（帯毎にリングを持つので、帯の境目の入力行は両方で横方向を計算する）
+	Image Resize(const Image& image, int width, int height, ResizeFilter filter) {
+		Image result(width, height, 3);
+		if (!image.data() || image.channel < 3 || width <= 0 || height <= 0) return result;
+
+		const int srcWidth = static_cast<int>(image.width);
+		const int srcHeight = static_cast<int>(image.height);
+		const int srcChannel = static_cast<int>(image.channel);
+		const auto horizontal = MakeTaps(srcWidth, width, filter);
+		const auto vertical = MakeTaps(srcHeight, height, filter);
+
+		// 帯の境目で計算し直す入力行が、帯の入力行の1/8くらいに収まる高さにする
+		const float scale = static_cast<float>(srcHeight) / height;
+		const int bandRows = std::max(16, static_cast<int>(std::ceil(vertical.count * 8 / scale)));
+
+		const size_t rowLength = static_cast<size_t>(width) * 3;
+		ForEachBand(height, [&](int y0, int y1) {
+			// 横方向にリサイズ済みの行（入力行番号 % count で入れる）
+			std::vector<float> rows(rowLength * vertical.count);
+			std::vector<int> rowIndex(vertical.count, -1);
+			std::vector<float> source(static_cast<size_t>(srcWidth) * 4);
+			auto horizontalRow = [&](int y) -> const float* {
+				auto row = &rows[(y % vertical.count) * rowLength];
+				if (rowIndex[y % vertical.count] == y) return row;
+				rowIndex[y % vertical.count] = y;
+
+				// 入力行をfloatに
+				WithChannel(srcChannel, [&](auto srcChannel) {
+					auto src = image.data() + static_cast<size_t>(y) * srcWidth * srcChannel;
+					for (int x = 0; x < srcWidth; ++x) {
+						source[x * 4 + 0] = src[x * srcChannel + 0];
+						source[x * 4 + 1] = src[x * srcChannel + 1];
+						source[x * 4 + 2] = src[x * srcChannel + 2];
+					}
+				});
+				HorizontalRow(horizontal, source.data(), width, row);
+				return row;
+			};
+
+			// 縦方向の積和（行単位で連続なのでベクトル化される、積和の途中がL1に収まるように区切る）
+			constexpr size_t kChunk = 2048;
+			std::vector<const float*> taps(vertical.count);
+			std::vector<float> weights(vertical.count);
+			std::array<float, kChunk> accum;
+			for (int y = y0; y < y1; ++y) {
+				int count = 0;
+				auto w = &vertical.weights[static_cast<size_t>(y) * vertical.count];
+				for (int k = 0; k < vertical.count; ++k) {
+					if (w[k] == 0.0f) continue;
+					taps[count] = horizontalRow(vertical.start[y] + k);
+					weights[count++] = w[k];
+				}
+				auto dst = result.data() + static_cast<size_t>(y) * rowLength;
+				for (size_t i0 = 0; i0 < rowLength; i0 += kChunk) {
+					const size_t n = std::min(kChunk, rowLength - i0);
+					std::fill_n(accum.begin(), n, 0.0f);
+					for (int k = 0; k < count; ++k) {
+						const float* row = taps[k] + i0;
+						const float weight = weights[k];
+						for (size_t i = 0; i < n; ++i) accum[i] += row[i] * weight;
+					}
+					size_t i = 0;
+#ifdef IMAGEPROCESS_SIMD
+					// +0.5して切り捨て、パックの飽和で0～255に
+					const auto half = _mm_set1_ps(0.5f);
+					for (; i + 16 <= n; i += 16) {
+						__m128i v[4];
+						for (int j = 0; j < 4; ++j) v[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(&accum[i + j * 4]), half));
+						const auto packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i0 + i), packed);
+					}
+#endif
+					for (; i < n; ++i) dst[i0 + i] = static_cast<uint8_t>(std::clamp(accum[i] + 0.5f, 0.0f, 255.0f));
+				}
+			}
+		}, bandRows);
+		return result;
+	}
+
+	/// @brief push-pull用のピラミッドの段（RGB＋重みの4バイト）
+	struct Level {
+		int width, height;
+		std::vector<uint8_t> pixels;
+		Level(int w, int h) : width{ w }, height{ h }, pixels(static_cast<size_t>(w) * h * 4) {}
+		uint8_t* row(int y) { return pixels.data() + static_cast<size_t>(y) * width * 4; }
+		const uint8_t* row(int y) const { return pixels.data() + static_cast<size_t>(y) * width * 4; }
+	};
+
+	/// 2行を1行に縮小（2x2の重み付き平均）
+	/// @param rows 細かい段の2行（高さが奇数なら同じ行）
+	/// @param fineWidth 細かい段の幅
+	/// @param p 書き込み先（(fineWidth + 1) / 2 ピクセル）
+	/// @return 穴（重み0）の数
+	/// @note SIMD版は割り算をfloatで（分子も分母も2^24未満の整数で、商の小数部は1/1020以上離れるので切り捨ての結果は整数と同じ）
+	static int ReduceRow(const uint8_t* const (&rows)[2], int fineWidth, uint8_t* p) {
+		const int width = (fineWidth + 1) / 2;
+		int x = 0;
+#ifdef IMAGEPROCESS_SIMD
+		const auto zero = _mm_setzero_si128();
+		const auto colors16 = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		const auto weight16 = _mm_set_epi16(1, 0, 0, 0, 1, 0, 0, 0);
+		const auto colors32 = _mm_set_epi32(0, -1, -1, -1);
+		const auto one = _mm_set1_ps(1.0f);
+		const auto colors8 = _mm_set1_epi32(0x00FFFFFF);
+		const auto round = _mm_set1_epi16(2);
+		// 2ピクセルずつ（細かい段の4ピクセル×2行）
+		for (; x * 2 + 3 < fineWidth; x += 2) {
+			const __m128i s[2] = {
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[0] + x * 8)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[1] + x * 8)),
+			};
+
+			// 重みが全部255なら4ピクセルの単純な平均（(sum + 2) / 4 で割り算と同じ結果）
+			const auto opaque = _mm_or_si128(_mm_and_si128(s[0], s[1]), colors8);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(opaque, _mm_set1_epi8(-1))) == 0xFFFF) {
+				const auto lo = _mm_add_epi16(_mm_unpacklo_epi8(s[0], zero), _mm_unpacklo_epi8(s[1], zero));
+				const auto hi = _mm_add_epi16(_mm_unpackhi_epi8(s[0], zero), _mm_unpackhi_epi8(s[1], zero));
+				const auto sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				const auto average = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(p + x * 4), _mm_packus_epi16(average, average));
+				continue;
+			}
+			// 重みが全部0なら穴
+			const auto weights = _mm_andnot_si128(colors8, _mm_or_si128(s[0], s[1]));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(weights, zero)) == 0xFFFF) {
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(p + x * 4), zero);
+				continue;
+			}
+
+			__m128i sum[2] = { zero, zero };
+			for (const auto row : s) {
+				for (int i = 0; i < 2; ++i) {
+					// 色×重み、重みのレーンは重み×1
+					const auto c = i ? _mm_unpackhi_epi8(row, zero) : _mm_unpacklo_epi8(row, zero);
+					const auto w = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xFF), 0xFF);
+					const auto m = _mm_mullo_epi16(c, _mm_or_si128(_mm_and_si128(w, colors16), weight16));
+					sum[i] = _mm_add_epi32(sum[i], _mm_add_epi32(_mm_unpacklo_epi16(m, zero), _mm_unpackhi_epi16(m, zero)));
+				}
+			}
+			__m128i gathered[2];
+			for (int i = 0; i < 2; ++i) {
+				// (sum + w / 2) / w、重みのレーンはそのまま（パックで255に飽和）
+				const auto w = _mm_shuffle_epi32(sum[i], 0xFF);
+				const auto n = _mm_cvtepi32_ps(_mm_add_epi32(sum[i], _mm_srli_epi32(w, 1)));
+				const auto q = _mm_cvttps_epi32(_mm_div_ps(n, _mm_max_ps(_mm_cvtepi32_ps(w), one)));
+				gathered[i] = _mm_or_si128(_mm_and_si128(q, colors32), _mm_andnot_si128(colors32, sum[i]));
+			}
+			const auto packed = _mm_packs_epi32(gathered[0], gathered[1]);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(p + x * 4), _mm_packus_epi16(packed, packed));
+		}
+#endif
+		for (; x < width; ++x) {
+			const int xs[2] = { x * 8, std::min(x * 2 + 1, fineWidth - 1) * 4 };
+			int sum[4] = {};
+			for (const auto row : rows) {
+				for (const int sx : xs) {
+					const auto s = row + sx;
+					sum[0] += s[0] * s[3];
+					sum[1] += s[1] * s[3];
+					sum[2] += s[2] * s[3];
+					sum[3] += s[3];
+				}
+			}
+			const auto q = p + x * 4;
+			const int w = std::max(sum[3], 1);
+			q[0] = static_cast<uint8_t>((sum[0] + w / 2) / w);
+			q[1] = static_cast<uint8_t>((sum[1] + w / 2) / w);
+			q[2] = static_cast<uint8_t>((sum[2] + w / 2) / w);
+			q[3] = static_cast<uint8_t>(std::min(sum[3], 255));
+		}
+		int holes = 0;
+		for (x = 0; x < width; ++x) holes += p[x * 4 + 3] == 0;
+		return holes;
+	}
+
+	/// 最下段（元画像＋アルファ）から1段縮小
+	/// @note 2行ずつRGB＋重み（不透明なら255、透明なら0）に詰め直してから縮小（不透明なピクセルの色の平均になる）
+	static Level PushBase(const Image& image, const Image& alpha, int& holes) {
+		const int width = static_cast<int>(image.width), height = static_cast<int>(image.height);
+		const int channel = static_cast<int>(image.channel), alphaChannel = static_cast<int>(alpha.channel);
+		Level coarse{ (width + 1) / 2, (height + 1) / 2 };
+		std::atomic<int> total{ 0 };
+		ForEachBand(coarse.height, [&](int y0, int y1) {
+			std::vector<uint8_t> packed(static_cast<size_t>(width) * 4 * 2);
+			const uint8_t* const rows[2] = { packed.data(), packed.data() + static_cast<size_t>(width) * 4 };
+			int count = 0;
+			for (int y = y0; y < y1; ++y) {
+				const int ys[2] = { y * 2, std::min(y * 2 + 1, height - 1) };
+				WithChannel(channel, [&](auto channel) {
+					WithChannel(alphaChannel, [&](auto alphaChannel) {
+						for (int j = 0; j < 2; ++j) {
+							const auto c = image.data() + static_cast<size_t>(ys[j]) * width * channel;
+							const auto a = alpha.data() + static_cast<size_t>(ys[j]) * width * alphaChannel;
+							const auto q = packed.data() + static_cast<size_t>(j) * width * 4;
+							for (int x = 0; x < width; ++x) {
+								q[x * 4 + 0] = c[x * channel + 0];
+								q[x * 4 + 1] = c[x * channel + 1];
+								q[x * 4 + 2] = c[x * channel + 2];
+								q[x * 4 + 3] = a[x * alphaChannel] ? 255 : 0;
+							}
+						}
+					});
+				});
+				count += ReduceRow(rows, width, coarse.row(y));
+			}
+			total += count;
+		});
+		holes = total;
+		return coarse;
+	}
+
+	/// 1段縮小（重み付きで色を集める）
+	static Level Push(const Level& fine, int& holes) {
+		Level coarse{ (fine.width + 1) / 2, (fine.height + 1) / 2 };
+		std::atomic<int> total{ 0 };
+		ForEachBand(coarse.height, [&](int y0, int y1) {
+			int count = 0;
+			for (int y = y0; y < y1; ++y) {
+				const uint8_t* const rows[2] = { fine.row(y * 2), fine.row(std::min(y * 2 + 1, fine.height - 1)) };
+				count += ReduceRow(rows, fine.width, coarse.row(y));
+			}
+			total += count;
+		});
+		holes = total;
+		return coarse;
+	}
+
+	/// 粗い段をバイリニアで引き伸ばす（1行の一部）
+	/// @param x0,x1 引き伸ばす範囲（x0は偶数）
+	/// @param up 書き込み先（x番目のピクセルに、RGB＋未使用の4バイト）
+	/// @note 2倍拡大なので重みは 9:3:3:1 の固定（縦に 3:1 で混ぜてから横に 3:1）
+	static void UpsampleRow(const Level& coarse, int y, int x0, int x1, uint8_t* up) {
+		const int cy0 = y / 2, cy1 = (y & 1) ? std::min(cy0 + 1, coarse.height - 1) : std::max(cy0 - 1, 0);
+		const auto row0 = coarse.row(cy0), row1 = coarse.row(cy1);
+		const auto pixel = [&](int x) {
+			const int cx0 = x / 2 * 4, cx1 = ((x & 1) ? std::min(x / 2 + 1, coarse.width - 1) : std::max(x / 2 - 1, 0)) * 4;
+			for (int c = 0; c < 3; ++c) {
+				up[x * 4 + c] = static_cast<uint8_t>((row0[cx0 + c] * 9 + row0[cx1 + c] * 3 + row1[cx0 + c] * 3 + row1[cx1 + c] + 8) >> 4);
+			}
+		};
+		int x = x0;
+#ifdef IMAGEPROCESS_SIMD
+		// 粗い段の2ピクセル（k, k+1）から4ピクセル、左右に1ピクセルずつ読むのでk=1から
+		for (; x < 2 && x < x1; ++x) pixel(x);
+		const auto zero = _mm_setzero_si128();
+		const auto round = _mm_set1_epi16(8);
+		const auto vertical = [&](int k) {
+			const auto a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row0 + k * 4)), zero);
+			const auto b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row1 + k * 4)), zero);
+			return _mm_add_epi16(_mm_add_epi16(a, _mm_add_epi16(a, a)), b);
+		};
+		for (int k = x / 2; k + 2 < coarse.width && x + 3 < x1; k += 2, x += 4) {
+			const auto center = vertical(k);
+			const auto center3 = _mm_add_epi16(_mm_add_epi16(center, center), _mm_add_epi16(center, round));
+			const auto even = _mm_srli_epi16(_mm_add_epi16(center3, vertical(k - 1)), 4);
+			const auto odd = _mm_srli_epi16(_mm_add_epi16(center3, vertical(k + 1)), 4);
+			const auto packed = _mm_packus_epi16(_mm_unpacklo_epi64(even, odd), _mm_unpackhi_epi64(even, odd));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(up + x * 4), packed);
+		}
+#endif
+		for (; x < x1; ++x) pixel(x);
+	}
+
+	/// 穴のある所だけ引き伸ばして書き込む（1行分）
+	/// @param hole xが穴ならtrueを返す関数
+	/// @param write (x, 引き伸ばした色) を受け取る関数、穴のピクセルだけ呼ぶ
+	/// @note 穴の無い所は引き伸ばさないように、kSpanピクセル毎に穴があるか見る
+	template <class HOLE, class WRITE>
+	static void FillRow(const Level& coarse, int width, int y, uint8_t* up, HOLE hole, WRITE write) {
+		constexpr int kSpan = 32;
+		for (int x0 = 0; x0 < width; x0 += kSpan) {
+			const int x1 = std::min(x0 + kSpan, width);
+			bool found = false;
+			for (int x = x0; x < x1; ++x) found |= hole(x);
+			if (!found) continue;
+
+			UpsampleRow(coarse, y, x0, x1, up);
+			for (int x = x0; x < x1; ++x) {
+				if (hole(x)) write(x, up + x * 4);
+			}
+		}
+	}
+
+	/// 1段拡大（重みの足りない分を粗い段の色で埋める）
+	static void Pull(Level& fine, const Level& coarse) {
+		ForEachBand(fine.height, [&](int y0, int y1) {
+			std::vector<uint8_t> up(static_cast<size_t>(fine.width) * 4);
+			for (int y = y0; y < y1; ++y) {
+				const auto p = fine.row(y);
+				FillRow(coarse, fine.width, y, up.data(), [p](int x) { return p[x * 4 + 3] != 255; }, [p](int x, const uint8_t* color) {
+					const auto q = p + x * 4;
+					const int w = q[3];
+					for (int c = 0; c < 3; ++c) q[c] = static_cast<uint8_t>((q[c] * w + color[c] * (255 - w) + 127) / 255);
+					q[3] = 255;
+				});
+			}
+		});
+	}
+
+	// 透明部分の穴埋め
+	void FillTransparent(const Image& image, const Image& alpha) {
+		if (!image.data() || !alpha.data() || image.channel < 3) return;
+		if (image.width != alpha.width || image.height != alpha.height) return;
+		const int width = static_cast<int>(image.width);
+		const int height = static_cast<int>(image.height);
+		const int channel = static_cast<int>(image.channel);
+		const int alphaChannel = static_cast<int>(alpha.channel);
+
+		// 全部透明か全部不透明なら何もしない
+		std::atomic<size_t> opaque{ 0 };
+		ForEachBand(height, [&](int y0, int y1) {
+			WithChannel(alphaChannel, [&](auto alphaChannel) {
+				const auto a = alpha.data() + static_cast<size_t>(y0) * width * alphaChannel;
+				const size_t count = static_cast<size_t>(y1 - y0) * width;
+				size_t sum = 0;
+				for (size_t i = 0; i < count; ++i) sum += a[i * alphaChannel] != 0;
+				opaque += sum;
+			});
+		});
+		if (opaque == 0 || opaque == static_cast<size_t>(width) * height) return;
+
+		// push：穴が無くなるまで縮小
+		std::vector<Level> levels;
+		int holes = 0;
+		levels.push_back(PushBase(image, alpha, holes));
+		while (holes > 0 && (levels.back().width > 1 || levels.back().height > 1)) {
+			auto coarse = Push(levels.back(), holes);
+			levels.push_back(std::move(coarse));
+		}
+
+		// pull：粗い段から順に重みの足りない所を埋める
+		for (size_t k = levels.size() - 1; k > 0; --k) {
+			Pull(levels[k - 1], levels[k]);
+		}
+
+		// 最下段：透明なピクセルだけ書き換える
+		ForEachBand(height, [&](int y0, int y1) {
+			std::vector<uint8_t> up(static_cast<size_t>(width) * 4);
+			WithChannel(channel, [&](auto channel) {
+				WithChannel(alphaChannel, [&](auto alphaChannel) {
+					for (int y = y0; y < y1; ++y) {
+						const auto a = alpha.data() + static_cast<size_t>(y) * width * alphaChannel;
+						const auto p = image.data() + static_cast<size_t>(y) * width * channel;
+						FillRow(levels.front(), width, y, up.data(), [&](int x) { return a[x * alphaChannel] == 0; }, [&](int x, const uint8_t* color) {
+							const auto q = p + x * channel;
+							q[0] = color[0]; q[1] = color[1]; q[2] = color[2];
+						});
+					}
+				});
+			});
+		});
+	}
+}
@@ -0,0 +1,24 @@
+/**
+ * @file ImageProcess.h
+ * @author 青猫 (AonekoSS)
+ * @brief 画像処理（リサイズなど）
+ */
+#pragma once
+
+#include "StableDiffusion.h"
+
+namespace StableDiffusion {
+	/// リサイズ
+	/// @param image 元画像（3チャンネル以上、先頭3チャンネルだけ使う）
+	/// @param width,height リサイズ後のサイズ
+	/// @param filter 補間フィルタ
+	/// @return リサイズした画像（3チャンネル）
+	/// @note 縦横分離のフィルタ。縮小時はフィルタ幅を広げてエイリアスを抑える
+	extern Image Resize(const Image& image, int width, int height, ResizeFilter filter);
+
+	/// 透明部分の穴埋め
+	/// @param image 対象画像（先頭3チャンネルを書き換える）
+	/// @param alpha アルファ（1チャンネル、0のピクセルを周りの色で埋める）
+	/// @note push-pull（縮小ピラミッドで色を集めて、拡大しながら穴に流し込む）
+	extern void FillTransparent(const Image& image, const Image& alpha);
+}
@@ -0,0 +1,123 @@
+/**
+ * @file IniFile.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイル（iniファイル）の読み込み
+ */
+#include "pch.h"
+
+#include "IniFile.h"
+
+namespace IniFile {
+	/// 前後の空白を削る
+	static std::string Trim(const std::string& text) {
+		const auto first = text.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos) return std::string();
+		const auto last = text.find_last_not_of(" \t\r\n");
+		return text.substr(first, last - first + 1);
+	}
+
+	/// 小文字化（ASCIIだけ）
+	static char Lower(char c) {
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+
+	size_t Table::NoCaseHash::operator()(std::string_view text) const {
+		uint64_t hash = 0xCBF29CE484222325ull; // FNV-1a
+		for (auto c : text) hash = (hash ^ static_cast<uint8_t>(Lower(c))) * 0x100000001B3ull;
+		return static_cast<size_t>(hash);
+	}
+
+	bool Table::NoCaseEqual::operator()(std::string_view a, std::string_view b) const {
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return Lower(x) == Lower(y); });
+	}
+
+	/// 値の整形（コメント削除とアンクォート）
+	static std::string Value(const std::string& raw) {
+		auto text = raw;
+
+		// コメント削除
+		auto commentPos = text.find_first_of("#;");
+		if (commentPos != std::string::npos) {
+			text.erase(commentPos);
+		}
+		text = Trim(text);
+
+		// アンクォート
+		if (text.length() >= 2 && text.front() == '"' && text.back() == '"') {
+			text = text.substr(1, text.length() - 2);
+		}
+		return text;
+	}
+
+	const std::string* Table::Find(std::string_view section, std::string_view key) const {
+		auto s = sections_.find(section);
+		if (s == sections_.end()) return nullptr;
+		auto k = s->second.find(key);
+		if (k == s->second.end()) return nullptr;
+		return &k->second;
+	}
+
+	void Table::Parse(const std::string& text) {
+		sectionNames_.clear();
+		sections_.clear();
+
+		NoCaseMap<std::string>* current = nullptr;
+		size_t pos = (text.compare(0, 3, "\xEF\xBB\xBF") == 0) ? 3 : 0; // BOM
+		while (pos < text.size()) {
+			auto end = text.find('\n', pos);
+			if (end == std::string::npos) end = text.size();
+			const auto line = Trim(text.substr(pos, end - pos));
+			pos = end + 1;
+
+			// 空行とコメント行
+			if (line.empty() || line.front() == ';' || line.front() == '#') continue;
+
+			// セクション（同じ名前がまた出てきたら続きとして扱う）
+			if (line.front() == '[') {
+				const auto close = line.find(']');
+				const auto name = Trim(line.substr(1, close == std::string::npos ? std::string::npos : close - 1));
+				auto [it, inserted] = sections_.try_emplace(name);
+				if (inserted) sectionNames_.push_back(name);
+				current = &it->second;
+				continue;
+			}
+
+			// キー（同じキーは最初のものが有効）
+			const auto equal = line.find('=');
+			if (!current || equal == std::string::npos) continue;
+			const auto key = Trim(line.substr(0, equal));
+			if (key.empty()) continue;
+			current->try_emplace(key, Value(line.substr(equal + 1)));
+		}
+	}
+
+	/// 読み込み済みのファイル
+	struct Entry {
+		std::filesystem::file_time_type time{};
+		uintmax_t size{ 0 };
+		std::shared_ptr<const Table> table;
+	};
+	static std::mutex cacheMutex;
+	static std::unordered_map<std::string, Entry> cache;
+
+	std::shared_ptr<const Table> Load(const std::string& filePath) {
+		// 更新日時とサイズが同じなら読み直さない
+		std::error_code error;
+		const auto time = std::filesystem::last_write_time(filePath, error);
+		const auto size = error ? 0 : std::filesystem::file_size(filePath, error);
+		if (error) return std::make_shared<Table>();
+
+		std::lock_guard lock(cacheMutex);
+		auto& entry = cache[filePath];
+		if (entry.table && entry.time == time && entry.size == size) return entry.table;
+
+		std::ifstream file(filePath, std::ios::binary);
+		if (!file) return std::make_shared<Table>();
+		const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		auto table = std::make_shared<Table>();
+		table->Parse(text);
+		entry = Entry{ time, size, table };
+		return table;
+	}
+}
@@ -0,0 +1,49 @@
+/**
+ * @file IniFile.h
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイル（iniファイル）の読み込み
+ * @note ファイル全体を一度だけ読んでセクション/キーの表にする（更新日時が変わるまで使い回す）
+ */
+#pragma once
+
+namespace IniFile {
+	/// 読み込んだ内容
+	/// @note セクション名とキーは大文字小文字を区別しない（GetPrivateProfileStringと同じ）
+	class Table {
+	public:
+		/// 値の取得
+		/// @param section セクション
+		/// @param key キー
+		/// @return コメントを除いてアンクォートした値（無ければnullptr）
+		/// @note 大文字小文字を無視したハッシュで直接引くので、メモリ確保はしない
+		const std::string* Find(std::string_view section, std::string_view key) const;
+
+		/// セクション名の一覧（ファイルに出てきた順）
+		const std::vector<std::string>& Sections() const { return sectionNames_; }
+
+		/// 読み込み
+		/// @param text ファイルの内容
+		void Parse(const std::string& text);
+
+	private:
+		/// 大文字小文字を無視したハッシュと比較（ASCIIだけ）
+		struct NoCaseHash {
+			using is_transparent = void;
+			size_t operator()(std::string_view text) const;
+		};
+		struct NoCaseEqual {
+			using is_transparent = void;
+			bool operator()(std::string_view a, std::string_view b) const;
+		};
+		template <class T>
+		using NoCaseMap = std::unordered_map<std::string, T, NoCaseHash, NoCaseEqual>;
+
+		std::vector<std::string> sectionNames_;
+		NoCaseMap<NoCaseMap<std::string>> sections_;
+	};
+
+	/// 読み込み
+	/// @param filePath ファイルのパス
+	/// @return 読み込んだ内容（前回から更新されていなければ前回のもの、読めなければ空の表）
+	extern std::shared_ptr<const Table> Load(const std::string& filePath);
+}
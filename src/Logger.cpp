@@ -0,0 +1,168 @@
+/**
+ * @file Logger.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief デバッグログの非同期書き出し
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Logger.h"
+
+namespace Logger {
+	// リングバッファ（複数スレッドから積んで書き出しスレッドが取り出す）
+	// @note スロット毎の通し番号で空きと書き込み済みを見分ける（ロック無し）
+	constexpr size_t kSlots = 512;
+	constexpr size_t kSlotBytes = 2048; // これより長い行は切り詰める
+	struct Slot {
+		std::atomic<size_t> sequence;
+		uint32_t length;
+		char text[kSlotBytes];
+	};
+	static std::unique_ptr<Slot[]> slots;
+
+	// 行頭のレベルのタグ（LogLevelの順、grepで拾えるように同じ幅で）
+	constexpr const char* kTags[] = { "[E] ", "[W] ", "[I] ", "[D] " };
+	constexpr size_t kTagBytes = 4;
+	static std::atomic<size_t> head;  // 次に積む位置（書き込み側）
+	static size_t tail;               // 次に取り出す位置（書き出しスレッドだけが触る）
+
+	// 設定
+	static std::string logPath;
+	static std::atomic<int> logLevel{ LOG_INFO };
+	static std::atomic<uint64_t> logMaxBytes{ 1024 << 10 };
+
+	// 書き出しスレッド
+	static std::mutex writerMutex;
+	static std::condition_variable writerCondition;
+	static std::thread writerThread;
+	static std::atomic<bool> writerRunning;
+	static bool writerExit;
+	static std::atomic<bool> writerWake; // 起こす時に立てる（ロック無しで立てるので取りこぼしてもタイムアウトで拾う）
+
+	void Open(const std::string& filePath) {
+		logPath = filePath;
+		std::ofstream(logPath, std::ios::binary | std::ios::trunc);
+
+		slots = std::make_unique<Slot[]>(kSlots);
+		for (size_t i = 0; i < kSlots; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+		head = 0;
+		tail = 0;
+	}
+
+	void Configure(LogLevel level, int maxKB) {
+		logLevel = level;
+		logMaxBytes = static_cast<uint64_t>(std::max(maxKB, 0)) << 10;
+	}
+
+	bool Enabled(LogLevel level) {
+		return level <= logLevel.load(std::memory_order_relaxed);
+	}
+
+	/// 取り出して書き出す（書き出しスレッドから）
+	/// @return 書き出した行数
+	static size_t Drain(std::ofstream& file, uint64_t& fileBytes) {
+		size_t count = 0;
+		while (true) {
+			auto& slot = slots[tail % kSlots];
+			if (slot.sequence.load(std::memory_order_acquire) != tail + 1) break;
+
+			// 上限を超えたら古い方に回す
+			const auto maxBytes = logMaxBytes.load(std::memory_order_relaxed);
+			if (maxBytes && fileBytes + slot.length > maxBytes) {
+				file.close();
+				std::error_code error;
+				std::filesystem::rename(logPath, logPath + ".old", error);
+				file.open(logPath, std::ios::binary | std::ios::trunc);
+				fileBytes = 0;
+			}
+			file.write(slot.text, slot.length);
+			fileBytes += slot.length;
+
+			slot.sequence.store(tail + kSlots, std::memory_order_release);
+			++tail;
+			++count;
+		}
+		return count;
+	}
+
+	/// 書き出しスレッド
+	/// @note 普段は積む側から起こさない（システムコールを避ける）、少し寝てはまとめて書き出す
+	static void WriterWorker() {
+		std::ofstream file(logPath, std::ios::binary | std::ios::app);
+		std::error_code error;
+		uint64_t fileBytes = std::filesystem::file_size(logPath, error);
+		if (error) fileBytes = 0;
+
+		while (true) {
+			if (Drain(file, fileBytes)) file.flush();
+			std::unique_lock lock(writerMutex);
+			writerCondition.wait_for(lock, std::chrono::milliseconds(50), [] { return writerExit || writerWake; });
+			if (writerExit) break;
+			writerWake = false;
+		}
+		Drain(file, fileBytes);
+		file.flush();
+	}
+
+	/// 書き出しスレッドの開始（最初の書き込みで）
+	static void StartWriter() {
+		std::lock_guard lock(writerMutex);
+		if (writerRunning) return;
+		writerExit = false;
+		writerThread = std::thread(WriterWorker);
+		writerRunning = true;
+	}
+
+	/// 書き出しスレッドを起こす
+	static void Wake() {
+		writerWake = true;
+		writerCondition.notify_one();
+	}
+
+	void Write(LogLevel level, const char* format, va_list args) {
+		if (!slots || !Enabled(level)) return;
+		if (!writerRunning.load(std::memory_order_acquire)) StartWriter();
+
+		// 空きスロットの確保
+		size_t pos = head.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &slots[pos % kSlots];
+			const auto sequence = slot->sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (diff < 0) {
+				// 一杯なら書き出しスレッドを起こして空くのを待つ（ログは捨てない）
+				if (!writerRunning.load(std::memory_order_acquire)) StartWriter();
+				Wake();
+				std::this_thread::yield();
+				pos = head.load(std::memory_order_relaxed);
+			} else {
+				pos = head.load(std::memory_order_relaxed);
+			}
+		}
+
+		// スロットに直接書式化（レベルのタグと改行込み、溢れたら切り詰める）
+		memcpy(slot->text, kTags[std::clamp<int>(level, LOG_ERROR, LOG_DEBUG)], kTagBytes);
+		int length = vsnprintf(slot->text + kTagBytes, kSlotBytes - kTagBytes - 1, format, args);
+		length = kTagBytes + std::clamp(length, 0, static_cast<int>(kSlotBytes - kTagBytes - 2));
+		slot->text[length++] = '\n';
+		slot->length = static_cast<uint32_t>(length);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+
+		// 半分埋まったら寝てる間に溢れないように起こしておく
+		if (pos % (kSlots / 2) == 0) Wake();
+	}
+
+	void Terminate() {
+		{
+			std::lock_guard lock(writerMutex);
+			if (!writerRunning) return;
+			writerExit = true;
+		}
+		writerCondition.notify_one();
+		writerThread.join();
+		writerRunning = false;
+	}
+}
@@ -0,0 +1,31 @@
+/**
+ * @file Logger.h
+ * @author 青猫 (AonekoSS)
+ * @brief デバッグログの非同期書き出し
+ * @note print()はリングバッファに書式化して積むだけ、ファイルへの書き出しは専用スレッドでまとめて
+ */
+#pragma once
+
+namespace Logger {
+	/// 書き出し先の設定（前回のログは消す）
+	/// @param filePath ログファイルのパス
+	/// @note DllMainから呼ばれるのでスレッドは立てない（最初の書き込みで立てる）
+	extern void Open(const std::string& filePath);
+
+	/// 設定
+	/// @param level これより詳しいログは捨てる
+	/// @param maxKB ファイルの上限（超えたら.oldに回して新しく書き始める、0なら上限無し）
+	extern void Configure(LogLevel level, int maxKB);
+
+	/// 出力するレベルか
+	extern bool Enabled(LogLevel level);
+
+	/// 書き込み
+	/// @note 行頭にレベルのタグ（[E] [W] [I] [D]）を付ける
+	/// @note 空きスロットが無ければ書き出されるまで待つ（ログは捨てない）
+	extern void Write(LogLevel level, const char* format, va_list args);
+
+	/// 終了（溜まってる分を全部書き出してスレッドを止める）
+	/// @note この後の書き込みは次の書き込みでまたスレッドを立てる
+	extern void Terminate();
+}
@@ -0,0 +1,200 @@
+/**
+ * @file Metrics.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 実行統計
+ */
+#include "pch.h"
+
+#include "Metrics.h"
+
+namespace Metrics {
+	/// 時間の分布（1msから倍々を4分割した区間、はみ出した分は両端に）
+	class Histogram {
+	public:
+		static constexpr int kBucketsPerOctave = 4;
+		static constexpr int kBuckets = 18 * kBucketsPerOctave; // 1ms〜約4分
+
+		void Add(double seconds) {
+			const double ms = std::max(seconds * 1e3, 0.0);
+			const int bucket = ms <= 1.0 ? 0 : std::min(static_cast<int>(std::log2(ms) * kBucketsPerOctave) + 1, kBuckets - 1);
+			++buckets[bucket];
+			++count;
+			sum += seconds;
+			minimum = count == 1 ? seconds : std::min(minimum, seconds);
+			maximum = std::max(maximum, seconds);
+		}
+
+		/// 区間の上端（秒）
+		static double UpperBound(int bucket) {
+			return std::exp2(static_cast<double>(bucket) / kBucketsPerOctave) * 1e-3;
+		}
+
+		/// パーセンタイル（区間の上端で近似、実測の最大は超えない）
+		double Percentile(double p) const {
+			if (!count) return 0.0;
+			const auto rank = static_cast<uint64_t>(std::ceil(p * count));
+			uint64_t seen = 0;
+			for (int i = 0; i < kBuckets; ++i) {
+				seen += buckets[i];
+				if (seen >= std::max<uint64_t>(rank, 1)) return std::min(UpperBound(i), maximum);
+			}
+			return maximum;
+		}
+
+		double Mean() const { return count ? sum / count : 0.0; }
+
+		std::array<uint64_t, kBuckets> buckets{};
+		uint64_t count{ 0 };
+		double sum{ 0.0 };
+		double minimum{ 0.0 };
+		double maximum{ 0.0 };
+	};
+
+	/// 転送速度の集計
+	struct Rate {
+		const char* label;
+		uint64_t count;
+		double seconds;
+		int64_t pixels;
+	};
+
+	/// 統計（直近の実行とセッション全体で同じもの）
+	struct Stats {
+		int runs{ 0 };
+		double runSeconds{ 0.0 };
+		Histogram steps;
+		Histogram contextLoads;
+		std::vector<Rate> rates;
+		uint64_t peakBytes{ 0 }; // 実行中に測った使用メモリの最大
+
+		/// it/s（ステップの合計時間から）
+		double IterationsPerSecond() const { return steps.sum > 0.0 ? steps.count / steps.sum : 0.0; }
+	};
+
+	static std::mutex statsMutex;
+	static Stats lastRun, session;
+	static bool running; // BeginRunからEndRunまで（メモリを測る期間）
+
+	/// 両方に足す
+	template <class F>
+	static void Record(F&& f) {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		f(lastRun);
+		f(session);
+	}
+
+	uint64_t CurrentMemoryBytes() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.WorkingSetSize;
+#else
+		// 2つ目が常駐ページ数
+		unsigned long long size = 0, resident = 0;
+		FILE* file = fopen("/proc/self/statm", "r");
+		if (!file) return 0;
+		const bool read = fscanf(file, "%llu %llu", &size, &resident) == 2;
+		fclose(file);
+		return read ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+	}
+
+	// @note プロセス全体の最大（PeakWorkingSetSize）だと前の実行やモデルの入れ替えの分が残るので、
+	//       実行中に今の値を取って直近の実行の最大を残し、セッションには終わった実行の分だけ反映する
+	void BeginRun() {
+		const auto bytes = CurrentMemoryBytes();
+		std::lock_guard<std::mutex> lock(statsMutex);
+		lastRun = Stats{};
+		lastRun.peakBytes = bytes;
+		running = true;
+	}
+
+	void EndRun(double seconds) {
+		const auto bytes = CurrentMemoryBytes();
+		std::lock_guard<std::mutex> lock(statsMutex);
+		running = false;
+		lastRun.peakBytes = std::max(lastRun.peakBytes, bytes);
+		session.peakBytes = std::max(session.peakBytes, lastRun.peakBytes);
+		for (auto* stats : { &lastRun, &session }) {
+			++stats->runs;
+			stats->runSeconds += seconds;
+		}
+	}
+
+	void SampleMemory() {
+		const auto bytes = CurrentMemoryBytes();
+		std::lock_guard<std::mutex> lock(statsMutex);
+		if (running) lastRun.peakBytes = std::max(lastRun.peakBytes, bytes);
+	}
+
+	void Steps(const std::vector<float>& seconds) {
+		Record([&](Stats& stats) {
+			for (auto time : seconds) stats.steps.Add(time);
+		});
+	}
+
+	void ContextLoad(double seconds) {
+		Record([&](Stats& stats) { stats.contextLoads.Add(seconds); });
+	}
+
+	void Throughput(const char* label, double seconds, int64_t pixels) {
+		Record([&](Stats& stats) {
+			auto found = std::find_if(stats.rates.begin(), stats.rates.end(), [label](const Rate& rate) { return strcmp(rate.label, label) == 0; });
+			if (found == stats.rates.end()) found = stats.rates.insert(stats.rates.end(), Rate{ label, 0, 0.0, 0 });
+			++found->count;
+			found->seconds += seconds;
+			found->pixels += pixels;
+		});
+	}
+
+	std::string Summary() {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		char text[128];
+		if (lastRun.steps.count) {
+			snprintf(text, sizeof(text), "last run: %.2f it/s, %.1f GB peak", lastRun.IterationsPerSecond(), lastRun.peakBytes / double(1ull << 30));
+		} else {
+			snprintf(text, sizeof(text), "last run: cached, %.1f GB peak", lastRun.peakBytes / double(1ull << 30));
+		}
+		return text;
+	}
+
+	/// 統計を書式化
+	static void Write(std::ofstream& file, const char* title, const Stats& stats) {
+		char line[256];
+		auto put = [&](const char* format, auto... args) {
+			snprintf(line, sizeof(line), format, args...);
+			file << line << "\n";
+		};
+		put("[%s]", title);
+		put("runs = %d (%.2f s)", stats.runs, stats.runSeconds);
+		put("peak memory = %.0f MB", stats.peakBytes / double(1ull << 20));
+		put("steps = %llu, %.2f it/s", static_cast<unsigned long long>(stats.steps.count), stats.IterationsPerSecond());
+		if (stats.steps.count) {
+			put("step ms: min %.1f, mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f",
+				stats.steps.minimum * 1e3, stats.steps.Mean() * 1e3, stats.steps.Percentile(0.5) * 1e3,
+				stats.steps.Percentile(0.9) * 1e3, stats.steps.Percentile(0.99) * 1e3, stats.steps.maximum * 1e3);
+			for (int i = 0; i < Histogram::kBuckets; ++i) {
+				if (!stats.steps.buckets[i]) continue;
+				put("  <= %8.1f ms: %llu", Histogram::UpperBound(i) * 1e3, static_cast<unsigned long long>(stats.steps.buckets[i]));
+			}
+		}
+		if (stats.contextLoads.count) {
+			put("model loads = %llu, mean %.2f s, max %.2f s", static_cast<unsigned long long>(stats.contextLoads.count),
+				stats.contextLoads.Mean(), stats.contextLoads.maximum);
+		}
+		for (const auto& rate : stats.rates) {
+			put("%s = %llu times, %.1f Mpix/s", rate.label, static_cast<unsigned long long>(rate.count),
+				rate.seconds > 0.0 ? rate.pixels / rate.seconds * 1e-6 : 0.0);
+		}
+		file << "\n";
+	}
+
+	void Dump(const std::string& filePath) {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		if (!session.runs && !session.steps.count) return;
+		std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+		if (!file) return;
+		Write(file, "last run", lastRun);
+		Write(file, "session", session);
+	}
+}
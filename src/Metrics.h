@@ -0,0 +1,44 @@
+/**
+ * @file Metrics.h
+ * @author 青猫 (AonekoSS)
+ * @brief 実行統計（ステップ時間の分布、it/s、モデルのロード時間、転送速度、ピークメモリ）
+ * @note 直近の実行分とセッション全体の分を溜めて、終了時にファイルに書き出す
+ */
+#pragma once
+
+namespace Metrics {
+	/// 実行の開始（直近の実行分をリセットしてメモリの計測を始める）
+	extern void BeginRun();
+
+	/// 実行の終了（メモリの計測を終える）
+	/// @param seconds 実行にかかった秒数
+	extern void EndRun(double seconds);
+
+	/// 使用メモリの計測（実行中だけ、その実行の最大値を残す）
+	/// @note 生成のステップ毎に呼ばれる
+	extern void SampleMemory();
+
+	/// サンプリングのステップ
+	/// @param seconds 各ステップにかかった秒数（書き出しか引き継ぎに使われた生成の分だけ渡す）
+	extern void Steps(const std::vector<float>& seconds);
+
+	/// モデルのロード
+	/// @param seconds ロードにかかった秒数
+	extern void ContextLoad(double seconds);
+
+	/// 転送
+	/// @param label 処理名（文字列リテラルのみ、ポインタのまま保持する）
+	/// @param seconds かかった秒数
+	/// @param pixels 処理したピクセル数
+	extern void Throughput(const char* label, double seconds, int64_t pixels);
+
+	/// 直近の実行の要約（"last run: 1.8 it/s, 11.2 GB peak"、peakは実行中に測った使用メモリの最大）
+	extern std::string Summary();
+
+	/// ファイルに書き出し（直近の実行とセッション全体）
+	/// @param filePath 書き出し先
+	extern void Dump(const std::string& filePath);
+
+	/// プロセスの今の使用メモリ（ワーキングセット、バイト）
+	extern uint64_t CurrentMemoryBytes();
+}
@@ -0,0 +1,148 @@
+/**
+ * @file ParamsTable.h
+ * @author 青猫 (AonekoSS)
+ * @brief 生成パラメータのフィールド表
+ * @note ini読み込み、ハッシュ、差分、ダイアログのプロパティとの同期をこの表から作る（フィールドを足す時はここに一行足すだけ）
+ */
+#pragma once
+
+#include "StableDiffusion.h"
+#include "Hash.h"
+
+namespace StableDiffusion::ParamsTable {
+	/// フィールドの分類
+	enum Flags : uint32_t {
+		OPTION = 1 << 0, // 動作オプション（生成結果には関係しない）
+		MODEL = 1 << 1,  // モデル関係（変わったらコンテキストを作り直す）
+		RESULT = 1 << 2, // 生成結果に影響する（キャッシュのキーに入れる）
+	};
+
+	/// ダイアログのプロパティのキー（値はホストに保存されるので変えない）
+	enum PropertyKey : int {
+		NO_PROPERTY = 0, // ダイアログに出さない
+		ITEM_SETTING = 1,
+		ITEM_STEPS,
+		ITEM_STRENGTH,
+		ITEM_CONTROL_STRENGTH,
+		ITEM_PROMPT,
+		ITEM_NPROMPT,
+		ITEM_BATCH_COUNT,
+		ITEM_METRICS,
+	};
+
+	/// フィールド
+	template <class T>
+	struct Field {
+		const char* name; // iniのキー
+		T Params::* member;
+		uint32_t flags;
+		PropertyKey property{ NO_PROPERTY }; // 対応するダイアログのプロパティ（int、float、文字列のみ）
+	};
+
+	/// フィールド表（iniのキーはメンバ名と同じ）
+	/// @note 並び順を変えるとハッシュが変わる（ディスクキャッシュが無効になるだけ）
+	inline constexpr auto fields = std::make_tuple(
+		// 動作オプション
+		Field{ "mode", &Params::mode, RESULT },
+		Field{ "verbose", &Params::verbose, OPTION },
+		Field{ "log_level", &Params::log_level, OPTION },
+		Field{ "log_max_kb", &Params::log_max_kb, OPTION },
+		Field{ "trace", &Params::trace, OPTION },
+		Field{ "show_metrics", &Params::show_metrics, OPTION },
+		Field{ "backend", &Params::backend, RESULT }, // スタブの結果が本物のキャッシュとして使われないように
+		Field{ "stub_step_ms", &Params::stub_step_ms, RESULT }, // 待ち時間を変えて測る時にキャッシュで素通りしないように
+		Field{ "stub_load_ms", &Params::stub_load_ms, OPTION },
+		Field{ "preload", &Params::preload, OPTION },
+		Field{ "max_resident_models", &Params::max_resident_models, OPTION },
+		Field{ "model_memory_mb", &Params::model_memory_mb, OPTION },
+		Field{ "result_cache_mb", &Params::result_cache_mb, OPTION },
+		Field{ "result_cache_disk_mb", &Params::result_cache_disk_mb, OPTION },
+		Field{ "speculative", &Params::speculative, OPTION },
+		Field{ "speculative_delay_ms", &Params::speculative_delay_ms, OPTION },
+
+		// プレビュー設定（プレビューの時はPreviewParamsで生成パラメータに反映される）
+		Field{ "preview", &Params::preview, OPTION },
+		Field{ "preview_resolution", &Params::preview_resolution, OPTION },
+		Field{ "preview_steps", &Params::preview_steps, OPTION },
+		Field{ "preview_sample_method", &Params::preview_sample_method, OPTION },
+		Field{ "preview_cfg_scale", &Params::preview_cfg_scale, OPTION },
+		Field{ "preview_taesd_path", &Params::preview_taesd_path, OPTION },
+
+		// 基本設定
+		Field{ "model_path", &Params::model_path, MODEL | RESULT },
+		Field{ "clip_l_path", &Params::clip_l_path, MODEL | RESULT },
+		Field{ "clip_g_path", &Params::clip_g_path, MODEL | RESULT },
+		Field{ "t5xxl_path", &Params::t5xxl_path, MODEL | RESULT },
+		Field{ "diffusion_model_path", &Params::diffusion_model_path, MODEL | RESULT },
+		Field{ "vae_path", &Params::vae_path, MODEL | RESULT },
+		Field{ "taesd_path", &Params::taesd_path, MODEL | RESULT },
+		Field{ "controlnet_path", &Params::controlnet_path, MODEL | RESULT },
+		Field{ "lora_model_dir", &Params::lora_model_dir, MODEL | RESULT },
+		Field{ "embeddings_path", &Params::embeddings_path, MODEL | RESULT },
+		Field{ "stacked_id_embeddings_path", &Params::stacked_id_embeddings_path, MODEL | RESULT },
+		Field{ "vae_decode_only", &Params::vae_decode_only, MODEL },
+		Field{ "vae_tiling", &Params::vae_tiling, MODEL | RESULT },
+		Field{ "free_params_immediately", &Params::free_params_immediately, OPTION },
+		Field{ "n_threads", &Params::n_threads, MODEL },
+		Field{ "wtype", &Params::wtype, MODEL | RESULT },
+		Field{ "rng_type", &Params::rng_type, MODEL | RESULT },
+		Field{ "schedule", &Params::schedule, MODEL | RESULT },
+		Field{ "clip_on_cpu", &Params::clip_on_cpu, MODEL },
+		Field{ "control_net_cpu", &Params::control_net_cpu, MODEL },
+		Field{ "vae_on_cpu", &Params::vae_on_cpu, MODEL },
+
+		// 生成パラメータ
+		Field{ "prompt", &Params::prompt, RESULT, ITEM_PROMPT },
+		Field{ "negative_prompt", &Params::negative_prompt, RESULT, ITEM_NPROMPT },
+		Field{ "clip_skip", &Params::clip_skip, RESULT },
+		Field{ "cfg_scale", &Params::cfg_scale, RESULT },
+		Field{ "guidance", &Params::guidance, RESULT },
+		Field{ "width", &Params::width, RESULT },
+		Field{ "height", &Params::height, RESULT },
+		Field{ "sample_method", &Params::sample_method, RESULT },
+		Field{ "sample_steps", &Params::sample_steps, RESULT, ITEM_STEPS },
+		Field{ "batch_count", &Params::batch_count, RESULT, ITEM_BATCH_COUNT },
+		Field{ "tile_size", &Params::tile_size, RESULT },
+		Field{ "tile_overlap", &Params::tile_overlap, RESULT },
+		Field{ "tile_strength", &Params::tile_strength, RESULT },
+		Field{ "native_resolution", &Params::native_resolution, RESULT },
+		Field{ "resize_filter", &Params::resize_filter, RESULT },
+		Field{ "fill_transparent", &Params::fill_transparent, RESULT },
+		Field{ "mask_crop", &Params::mask_crop, OPTION }, // 生成範囲（width、height）が変わるだけ
+		Field{ "mask_islands", &Params::mask_islands, OPTION },
+		Field{ "mask_padding", &Params::mask_padding, OPTION },
+		Field{ "strength", &Params::strength, RESULT, ITEM_STRENGTH },
+		Field{ "seed", &Params::seed, RESULT },
+		Field{ "control_strength", &Params::control_strength, RESULT, ITEM_CONTROL_STRENGTH },
+		Field{ "style_ratio", &Params::style_ratio, RESULT },
+		Field{ "normalize_input", &Params::normalize_input, RESULT },
+		Field{ "input_id_images_path", &Params::input_id_images_path, RESULT }
+	);
+
+	/// 全フィールドの処理
+	/// @param func フィールドを受け取る処理（型毎にインスタンス化される）
+	template <class FUNC>
+	constexpr void ForEach(FUNC&& func) {
+		std::apply([&func](const auto&... field) { (func(field), ...); }, fields);
+	}
+
+	/// フィールドのハッシュ
+	/// @param hasher 追加先
+	/// @param params 生成パラメータ
+	/// @param flags 対象の分類（どれかが立っているフィールドだけ）
+	inline void HashFields(Hash::Hasher& hasher, const Params& params, uint32_t flags) {
+		ForEach([&](const auto& field) {
+			if (field.flags & flags) hasher(params.*field.member);
+		});
+	}
+
+	/// フィールドの差分
+	/// @return 値の違うフィールドの分類を全部まとめたもの（同じなら0）
+	inline uint32_t DiffFields(const Params& a, const Params& b) {
+		uint32_t diff = 0;
+		ForEach([&](const auto& field) {
+			if (!(a.*field.member == b.*field.member)) diff |= field.flags;
+		});
+		return diff;
+	}
+}
@@ -0,0 +1,263 @@
+/**
+ * @file ResultCache.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 生成結果のキャッシュ（メモリとディスクの二段）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Hash.h"
+#include "ResultCache.h"
+#include "ParamsTable.h"
+
+namespace StableDiffusion::ResultCache {
+	/// @brief メモリキャッシュのエントリ
+	struct Entry {
+		uint64_t key;
+		std::vector<Image> images;
+		size_t bytes;
+	};
+
+	/// @brief ディスクキャッシュのファイルヘッダ
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t count;
+		uint32_t reserved;
+	};
+
+	/// @brief ディスクキャッシュの画像ヘッダ（この後ろに画素データ）
+	struct ImageHeader {
+		uint32_t width;
+		uint32_t height;
+		uint32_t channel;
+		uint32_t reserved;
+	};
+
+	constexpr char kMagic[4] = { 'S', 'D', 'R', 'C' };
+	constexpr uint32_t kVersion = 1;
+
+	static std::mutex cacheMutex;
+	static std::list<Entry> memoryCache; // 先頭ほど最近使ったもの
+	static size_t memoryBytes;
+	static size_t memoryLimit;
+	static std::filesystem::path diskDirectory;
+	static uint64_t diskLimit;
+
+	/// 設定
+	void Configure(const std::string& directory, const Params& params) {
+		std::lock_guard lock(cacheMutex);
+		memoryLimit = static_cast<size_t>(std::max(params.result_cache_mb, 0)) << 20;
+		diskLimit = static_cast<uint64_t>(std::max(params.result_cache_disk_mb, 0)) << 20;
+		diskDirectory = std::filesystem::path(directory);
+	}
+
+	/// 入力画像のハッシュ
+	uint64_t InputHash(const Params& params, const Image& input) {
+		if (!UsesInput(params) || !input.data()) return 0;
+		return Hash::Hasher()(input.width)(input.height)(input.channel)(Hash::Bytes(input.data(), input.size())).value();
+	}
+
+	/// キャッシュキーの作成
+	uint64_t MakeKey(const Params& params, uint64_t inputHash) {
+		// シードがランダムなら毎回違う結果が欲しい筈
+		if (params.seed < 0) return 0;
+
+		// 生成結果に影響するパラメータだけ
+		Hash::Hasher hasher;
+		ParamsTable::HashFields(hasher, params, ParamsTable::RESULT);
+
+		// 入力画像（t2iでは使わないので含めない）
+		if (UsesInput(params)) hasher(inputHash);
+
+		// 0はキャッシュ無しの意味なので避ける
+		return hasher.value() | 1;
+	}
+
+	/// エントリのメモリ使用量
+	static size_t CountBytes(const std::vector<Image>& images) {
+		size_t bytes = 0;
+		for (const auto& image : images) bytes += image.size();
+		return bytes;
+	}
+
+	/// メモリキャッシュに登録（上限を超えたら古いものから捨てる）
+	static void StoreMemory(uint64_t key, const std::vector<Image>& images) {
+		const auto bytes = CountBytes(images);
+		if (bytes > memoryLimit) return;
+		memoryCache.push_front(Entry{ key, images, bytes });
+		memoryBytes += bytes;
+		while (memoryBytes > memoryLimit && !memoryCache.empty()) {
+			memoryBytes -= memoryCache.back().bytes;
+			memoryCache.pop_back();
+		}
+	}
+
+	/// ディスクキャッシュのファイル名
+	static std::filesystem::path DiskPath(uint64_t key) {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return diskDirectory / name;
+	}
+
+	/// ファイルのメモリマップ（書き込みはコピーオンライト）
+	/// @param path ファイルパス
+	/// @param size マップしたサイズの格納先
+	/// @return マップしたメモリ（スコープを抜けたらアンマップ）
+	static std::shared_ptr<void> MapFile(const std::filesystem::path& path, size_t& size) {
+#ifdef _WIN32
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return nullptr;
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(file, &fileSize);
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping) return nullptr;
+		void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!view) return nullptr;
+		size = static_cast<size_t>(fileSize.QuadPart);
+		return std::shared_ptr<void>(view, [](void* p) { UnmapViewOfFile(p); });
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return nullptr;
+		struct stat st {};
+		fstat(fd, &st);
+		const auto length = static_cast<size_t>(st.st_size);
+		void* view = length ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+		if (view == MAP_FAILED) return nullptr;
+		size = length;
+		return std::shared_ptr<void>(view, [length](void* p) { munmap(p, length); });
+#endif
+	}
+
+	/// ディスクキャッシュから読み込み
+	/// @note 画素データはコピーせずにマップしたメモリをそのまま使う
+	static std::vector<Image> FindDisk(uint64_t key) {
+		if (!diskLimit) return {};
+		const auto path = DiskPath(key);
+		size_t size = 0;
+		auto mapped = MapFile(path, size);
+		if (!mapped) return {};
+
+		auto base = static_cast<uint8_t*>(mapped.get());
+		FileHeader header;
+		if (size < sizeof(header)) return {};
+		memcpy(&header, base, sizeof(header));
+		if (memcmp(header.magic, kMagic, sizeof(kMagic)) || header.version != kVersion || header.key != key) return {};
+
+		std::vector<Image> images;
+		size_t offset = sizeof(header);
+		for (uint32_t i = 0; i < header.count; ++i) {
+			ImageHeader image;
+			if (size - offset < sizeof(image)) return {};
+			memcpy(&image, base + offset, sizeof(image));
+			offset += sizeof(image);
+			const auto bytes = static_cast<size_t>(image.width) * image.height * image.channel;
+			if (size - offset < bytes) return {};
+			images.emplace_back(image.width, image.height, image.channel, std::shared_ptr<void>(mapped, base + offset));
+			offset += bytes;
+		}
+
+		// 最近使った扱いに
+		std::error_code ec;
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+		return images;
+	}
+
+	/// ディスクキャッシュの容量を上限内に（古いものから削除）
+	static void TrimDisk() {
+		std::error_code ec;
+		std::vector<std::filesystem::directory_entry> files;
+		uint64_t total = 0;
+		for (const auto& entry : std::filesystem::directory_iterator(diskDirectory, ec)) {
+			if (entry.path().extension() != ".bin") continue;
+			total += entry.file_size(ec);
+			files.push_back(entry);
+		}
+		if (total <= diskLimit) return;
+
+		std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+			std::error_code ec;
+			return a.last_write_time(ec) < b.last_write_time(ec);
+		});
+		for (const auto& file : files) {
+			if (total <= diskLimit) break;
+			const auto bytes = file.file_size(ec);
+			if (std::filesystem::remove(file.path(), ec)) total -= bytes; // 使用中（マップ中）なら消せないので飛ばす
+		}
+	}
+
+	/// ディスクキャッシュに書き込み
+	static void StoreDisk(uint64_t key, const std::vector<Image>& images) {
+		if (!diskLimit || CountBytes(images) > diskLimit) return;
+		std::error_code ec;
+		std::filesystem::create_directories(diskDirectory, ec);
+
+		// 途中で落ちても壊れたファイルが残らないように一時ファイル経由で
+		const auto path = DiskPath(key);
+		auto temp = path;
+		temp += ".tmp";
+		{
+			std::ofstream file(temp, std::ios::binary);
+			if (!file) return;
+			FileHeader header{ {}, kVersion, key, static_cast<uint32_t>(images.size()), 0 };
+			memcpy(header.magic, kMagic, sizeof(kMagic));
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (const auto& image : images) {
+				ImageHeader imageHeader{ image.width, image.height, image.channel, 0 };
+				file.write(reinterpret_cast<const char*>(&imageHeader), sizeof(imageHeader));
+				file.write(reinterpret_cast<const char*>(image.data()), image.size());
+			}
+			if (!file) {
+				file.close();
+				std::filesystem::remove(temp, ec);
+				return;
+			}
+		}
+		std::filesystem::rename(temp, path, ec);
+		if (ec) std::filesystem::remove(temp, ec);
+		TrimDisk();
+	}
+
+	/// 検索
+	std::vector<Image> Find(uint64_t key) {
+		if (!key) return {};
+		std::lock_guard lock(cacheMutex);
+
+		// メモリ
+		auto found = std::find_if(memoryCache.begin(), memoryCache.end(), [key](const Entry& entry) { return entry.key == key; });
+		if (found != memoryCache.end()) {
+			memoryCache.splice(memoryCache.begin(), memoryCache, found);
+			print("result cache: memory hit %016llx", static_cast<unsigned long long>(key));
+			return found->images;
+		}
+
+		// ディスク（見つかったらメモリ側にも載せる）
+		auto images = FindDisk(key);
+		if (!images.empty()) {
+			print("result cache: disk hit %016llx", static_cast<unsigned long long>(key));
+			StoreMemory(key, images);
+		}
+		return images;
+	}
+
+	/// 登録
+	void Store(uint64_t key, const std::vector<Image>& images) {
+		if (!key || images.empty()) return;
+		std::lock_guard lock(cacheMutex);
+		if (std::any_of(memoryCache.begin(), memoryCache.end(), [key](const Entry& entry) { return entry.key == key; })) return;
+		StoreMemory(key, images);
+		StoreDisk(key, images);
+		print("result cache: store %016llx", static_cast<unsigned long long>(key));
+	}
+
+	/// 解放
+	void Clear() {
+		std::lock_guard lock(cacheMutex);
+		memoryCache.clear();
+		memoryBytes = 0;
+	}
+}
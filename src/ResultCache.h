@@ -0,0 +1,49 @@
+/**
+ * @file ResultCache.h
+ * @author 青猫 (AonekoSS)
+ * @brief 生成結果のキャッシュ（メモリとディスクの二段）
+ * @note 同じ設定＆同じ入力での再実行なら生成をスキップする
+ */
+#pragma once
+
+#include "StableDiffusion.h"
+
+namespace StableDiffusion::ResultCache {
+	/// 設定
+	/// @param directory ディスクキャッシュの置き場所
+	/// @param params 生成パラメータ（result_cache_mb、result_cache_disk_mbを使う）
+	extern void Configure(const std::string& directory, const Params& params);
+
+	/// 入力画像のハッシュ
+	/// @param params 生成パラメータ
+	/// @param input 入力画像
+	/// @return i2iかコントロールの時だけ入力画像のハッシュ（それ以外は0）
+	extern uint64_t InputHash(const Params& params, const Image& input);
+
+	/// キャッシュキーの作成
+	/// @param params 生成パラメータ
+	/// @param inputHash 入力画像のハッシュ（InputHashか、取り込み時にブロック毎のハッシュから作ったもの）
+	/// @return キャッシュキー（シードがランダムなどキャッシュできない時は0）
+	extern uint64_t MakeKey(const Params& params, uint64_t inputHash);
+
+	/// キャッシュキーの作成
+	/// @param params 生成パラメータ
+	/// @param input 入力画像（i2iかコントロールの時だけキーに含める）
+	/// @return キャッシュキー（シードがランダムなどキャッシュできない時は0）
+	inline uint64_t MakeKey(const Params& params, const Image& input) {
+		return MakeKey(params, InputHash(params, input));
+	}
+
+	/// 検索
+	/// @param key キャッシュキー
+	/// @return 見つかった生成結果（無ければ空）
+	extern std::vector<Image> Find(uint64_t key);
+
+	/// 登録
+	/// @param key キャッシュキー
+	/// @param images 生成結果
+	extern void Store(uint64_t key, const std::vector<Image>& images);
+
+	/// 解放（メモリ側のみ、ディスクはそのまま）
+	extern void Clear();
+}
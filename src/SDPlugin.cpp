@@ -9,6 +9,15 @@
 #include "SDPlugin.h"
 #include "FilterPlugIn.h"
 #include "StableDiffusion.h"
+#include "ParamsTable.h"
+#include "ResultCache.h"
+#include "Speculative.h"
+#include "Hash.h"
+#include "ImageProcess.h"
+#include "Config.h"
+#include "Logger.h"
+#include "Trace.h"
+#include "Metrics.h"
 
 using namespace FilterPlugIn;
 using namespace StableDiffusion;
@@ -23,32 +32,32 @@ std::string g_BasePath;
 /// デバッグログの書き出し先
 std::string g_DebugPath;
 
-/// 設定リスト
+/// 設定リスト（プロパティに登録した順、設定ファイルで増えたら後ろに足していく）
 std::vector<std::string> g_Settings;
 
 
 /// デバッグ出力の開始
 void InitDebugOutput(const std::string& basePath) {
 	g_DebugPath = basePath + "debuglog.txt";
-	FILE* fp = nullptr;
-	fopen_s(&fp, g_DebugPath.c_str(), "w");
-	if (fp) fclose(fp);
+	Logger::Open(g_DebugPath);
+	Trace::Open(basePath + "trace.json");
 }
 
 /// デバッグ出力
-/// @note ホストアプリがデバッガを嫌うから原始的なファイル出力で
+/// @note ホストアプリがデバッガを嫌うから原始的なファイル出力で（書き出しはLoggerのスレッドで）
 void print(const char* format, ...) {
-	if (g_DebugPath.empty()) return;
-	FILE* fp = nullptr;
-	fopen_s(&fp, g_DebugPath.c_str(), "a");
-	if (fp) {
-		va_list arg;
-		va_start(arg, format);
-		vfprintf(fp, format, arg);
-		va_end(arg);
-		fputs("\n", fp);
-		fclose(fp);
-	}
+	if (!Logger::Enabled(LOG_INFO)) return;
+	va_list arg;
+	va_start(arg, format);
+	Logger::Write(LOG_INFO, format, arg);
+	va_end(arg);
+}
+void print(LogLevel level, const char* format, ...) {
+	if (!Logger::Enabled(level)) return;
+	va_list arg;
+	va_start(arg, format);
+	Logger::Write(level, format, arg);
+	va_end(arg);
 }
 
 /// @brief ベースパス取得
@@ -82,22 +91,51 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD  fdwReason, LPVOID lpReserved) {
 	return TRUE;
 }
 
+/// 入力画像のバッファ
+/// @note ブロック毎のハッシュを覚えておいて、変わったブロックだけ取り込み直す
+struct InputBuffer {
+	Rect rect{};
+	std::optional<Image> image;
+	std::optional<Image> alpha; // 透明部分を埋める時だけ（1チャンネル）
+	bool filled{ false };
+	std::vector<Rect> blockRects;
+	std::vector<uint64_t> blockHashes;
+	uint64_t hash{ 0 }; // 画像全体のハッシュ（ブロック毎のハッシュから作る）
+};
+
 /// フィルター情報
 struct FilterInfo {
 	Server const* server;
 	StableDiffusion::Params params;
 	int setting;
+	bool showMetrics{ false }; // 統計表示のアイテムがあるか（フィルタ初期化時の設定）
+	int lastWidth{ 0 }, lastHeight{ 0 }; // 前回の生成範囲のサイズ（投機的生成に使う、範囲が複数なら0）
+	std::vector<InputBuffer> inputs; // 生成範囲毎の入力画像（実行を跨いで使い回す）
 };
 
-/// プロパティキー
-enum PropertyKey {
-	ITEM_SETTING = 1,
-	ITEM_STEPS,
-	ITEM_STRENGTH,
-	ITEM_CONTROL_STRENGTH,
-	ITEM_PROMPT,
-	ITEM_NPROMPT,
-};
+/// プロパティキー（生成パラメータとの対応はParamsTableに）
+using enum StableDiffusion::ParamsTable::PropertyKey;
+
+/// プロパティへの反映（型毎）
+static void SetProperty(Property& property, int key, int val) { property.setInteger(key, val); }
+static void SetProperty(Property& property, int key, float val) { property.setDecimal(key, val); }
+static void SetProperty(Property& property, int key, const std::string& val) { property.setStringDefault(key, val); }
+
+/// プロパティにできる型
+template <class T>
+concept PropertyValue = std::is_same_v<T, int> || std::is_same_v<T, float> || std::is_same_v<T, std::string>;
+
+/// プロパティに対応するフィールド全部の処理
+/// @param func フィールドを受け取る処理
+template <class FUNC>
+static void ForEachPropertyField(FUNC&& func) {
+	StableDiffusion::ParamsTable::ForEach([&func](const auto& field) {
+		using T = std::remove_cvref_t<decltype(std::declval<StableDiffusion::Params>().*field.member)>;
+		if constexpr (PropertyValue<T>) {
+			if (field.property != NO_PROPERTY) func(field);
+		}
+	});
+}
 
 /// プラグイン初期化
 /// @return 正常終了ならtrue
@@ -124,7 +162,14 @@ static bool TerminateModule(FilterPlugIn::Server* server, FilterPlugIn::Ptr* dat
 		*data = nullptr;
 	}
 	// StableDiffusionのDLL解放
+	Config::Stop();
+	StableDiffusion::Speculative::Terminate();
+	StableDiffusion::ResultCache::Clear();
 	StableDiffusion::Terminate();
+	TerminateParallelFor();
+	Trace::Flush();
+	Metrics::Dump(g_BasePath + "metrics.txt");
+	Logger::Terminate();
 	return true;
 }
 
@@ -136,23 +181,6 @@ static std::string GetIniPath()
 	return g_BasePath + "SDPlugin.ini";
 }
 
-/// @brief 設定ファイルのセクション
-/// @return COMMON以外のセクションを返す
-static std::vector<std::string> GetIniSections(const std::string& iniPath)
-{
-		char sections[4096];
-		GetPrivateProfileSectionNamesA(sections, sizeof(sections), iniPath.c_str());
-		char *section = sections;
-		std::vector<std::string> result;
-		while (*section != NULL)
-		{
-			std::string name = section;
-			if (name != "COMMON") result.push_back(name);
-			section += strlen(section) + 1;
-		}
-		return result;
-}
-
 /// @brief 文字列のUNICODE化
 /// @param str ShiftJIS文字列
 /// @return UNICODE文字列
@@ -166,18 +194,39 @@ std::wstring ShiftJIS_to_UTF16(const std::string& str)
 }
 
 /// プロパティの初期化
-static void InitProperty(Property& p) {
+/// @param showMetrics 統計表示のアイテムを足すか
+static void InitProperty(Property& p, bool showMetrics) {
 	auto setting = p.addEnumerationItem(ITEM_SETTING, "Setting");
 	for(int i = 0; i < g_Settings.size(); ++i) {
 		setting.addValue(i, ShiftJIS_to_UTF16(g_Settings[i])); // UI側はUNICODEが良い
 	}
 
 	p.addIntegerItem(ITEM_STEPS, "Steps", 20, 1, 60);
+	p.addIntegerItem(ITEM_BATCH_COUNT, "Batch Count", 1, 1, 8);
 	p.addDecimalItem(ITEM_STRENGTH, "Strength", 0.5, 0.0, 1.0);
 	p.addDecimalItem(ITEM_CONTROL_STRENGTH, "Control Strength", 8.0, 1.0, 20.0);
 
 	p.addStringItem(ITEM_PROMPT, "Prompt", 800);
 	p.addStringItem(ITEM_NPROMPT, "Negative Prompt", 800);
+
+	// 統計（表示専用、保存しない）
+	if (showMetrics) {
+		p.addStringItem(ITEM_METRICS, "Metrics", 80);
+		p.setStoreValue(ITEM_METRICS, false);
+		p.setStringDefault(ITEM_METRICS, "last run: -");
+	}
+}
+
+/// 設定リストの更新
+/// @note 設定ファイルで増えたセクションをプロパティの選択肢に足す（番号がずれないように後ろに）
+static void UpdateSettingList(Property& property) {
+	auto setting = property.enumerationItem(ITEM_SETTING);
+	const auto config = Config::Current();
+	for (const auto& name : config->sections) {
+		if (std::find(g_Settings.begin(), g_Settings.end(), name) != g_Settings.end()) continue;
+		setting.addValue(static_cast<int>(g_Settings.size()), ShiftJIS_to_UTF16(name));
+		g_Settings.push_back(name);
+	}
 }
 
 /// @brief 設定の切り替え
@@ -186,20 +235,19 @@ static void InitProperty(Property& p) {
 /// @param propertyObject 反映先プロパティ
 static void SwitchToSetting(int index, StableDiffusion::Params& params, Property& property) {
 	if (index < 0 || g_Settings.size() <= index) return;
-	const auto setting = g_Settings[index];
 
-	// コンフィグのロード
-	auto iniPath = GetIniPath();
-	auto common = LoadParams(iniPath, "COMMON");
-	params = LoadParams(iniPath, setting, common);
+	// コンフィグの取得（読み込み済みのもの、設定ファイルから消えていたらそのまま）
+	const auto config = Config::Current();
+	auto found = config->Find(g_Settings[index]);
+	if (!found) return;
+	params = *found;
+
+	// モデルの事前ロード（プロンプト入力中に裏で読み込んでおく）
+	StableDiffusion::Preload(g_BasePath, params);
 
 	// プロパティへの反映
 	property.setEnumeration(ITEM_SETTING, index);
-	property.setInteger(ITEM_STEPS, params.sample_steps);
-	property.setDecimal(ITEM_STRENGTH, params.strength);
-	property.setDecimal(ITEM_CONTROL_STRENGTH, params.control_strength);
-	property.setStringDefault(ITEM_PROMPT, params.prompt);
-	property.setStringDefault(ITEM_NPROMPT, params.negative_prompt);
+	ForEachPropertyField([&](const auto& field) { SetProperty(property, field.property, params.*field.member); });
 }
 
 /// プロパティ同期
@@ -209,6 +257,10 @@ static bool SyncProperty(Int itemKey, PropertyObject propertyObject, Ptr data) {
 	Property property(info.server, propertyObject);
 
 	switch (itemKey) {
+	case ITEM_METRICS:
+		// 表示専用なので書き換えられたら戻す（やり直しでバリエーションが進まないように変更無しで返す）
+		property.setString(ITEM_METRICS, Metrics::Summary());
+		return false;
 	case ITEM_SETTING:
 	{
 		// 設定変更を検出してコンフィグを切り替える
@@ -220,26 +272,43 @@ static bool SyncProperty(Int itemKey, PropertyObject propertyObject, Ptr data) {
 		}
 	}
 	break;
-	case ITEM_STEPS:
-		return property.sync(ITEM_STEPS, params.sample_steps);
-	case ITEM_STRENGTH:
-		return property.sync(ITEM_STRENGTH, params.strength);
-	case ITEM_CONTROL_STRENGTH:
-		return property.sync(ITEM_CONTROL_STRENGTH, params.control_strength);
-	case ITEM_PROMPT:
-		return property.sync(ITEM_PROMPT, params.prompt);
-	case ITEM_NPROMPT:
-		return property.sync(ITEM_NPROMPT, params.negative_prompt);
+	default:
+	{
+		// 生成パラメータに対応するプロパティ
+		bool changed = false;
+		ForEachPropertyField([&](const auto& field) {
+			if (field.property == itemKey) changed = property.sync(field.property, params.*field.member);
+		});
+		return changed;
+	}
 	}
 	return false;
 }
 
+/// 投機的生成のリクエスト
+/// @note 前回の選択範囲と入力画像で生成しておく（プレビュー有りならそっちで描くので不要）
+static void RequestSpeculative(const FilterInfo& info) {
+	const auto& params = info.params;
+	if (!params.speculative || params.preview || info.lastWidth <= 0 || info.lastHeight <= 0) return;
+	if (params.prompt.empty() || params.model_path.empty()) return;
+
+	// 入力画像を使うモードなら前回取り込んだもの
+	const bool useInput = StableDiffusion::UsesInput(params);
+	if (useInput && (info.inputs.empty() || !info.inputs.front().image)) return;
+
+	auto speculativeParams = params;
+	speculativeParams.width = info.lastWidth;
+	speculativeParams.height = info.lastHeight;
+	StableDiffusion::Speculative::Request(speculativeParams, useInput ? *info.inputs.front().image : Image(), useInput ? info.inputs.front().hash : 0);
+}
+
 /// プロパティコールバック
 static void FilterPropertyCallBack(PropertyCallBackResult* result, PropertyObject propertyObject, const Int itemKey, const PropertyCallBackNotify notify, Ptr data) {
 	(*result) = PropertyCallBackResult::NoModify;
 	if (notify != PropertyCallBackNotify::ValueChanged) return;
 	if (SyncProperty(itemKey, propertyObject, data)) {
 		(*result) = PropertyCallBackResult::Modify;
+		RequestSpeculative(*static_cast<FilterInfo*>(data));
 	}
 }
 
@@ -251,15 +320,16 @@ static bool InitializeFilter(FilterPlugIn::Server* server, FilterPlugIn::Ptr* da
 	auto info = static_cast<FilterInfo*>(*data);
 	info->server = server;
 
-	// 設定リストの初期化
-	g_Settings = GetIniSections(GetIniPath());
+	// 設定リストの初期化（設定ファイルの監視もここから）
+	Config::Start(GetIniPath());
+	g_Settings = Config::Current()->sections;
 
 	//	フィルタカテゴリ名とフィルタ名の設定
 	initialize.SetCategoryName("Stable Diffusion", 'x');
 	initialize.SetFilterName("Generate", 'x');
 
-	//	プレビュー無し（LCMとかで高速化出来たらONにしてもいいか？）
-	initialize.SetCanPreview(false);
+	//	プレビュー（COMMONのpreviewがONなら縮小＆LCMとかで高速に描いてから本番を描く）
+	initialize.SetCanPreview(Config::Current()->common.preview);
 
 	// ブランク画像でもOK
 	initialize.SetUseBlankImage(true);
@@ -268,8 +338,9 @@ static bool InitializeFilter(FilterPlugIn::Server* server, FilterPlugIn::Ptr* da
 	initialize.SetTargetKinds({ Initialize::Target::RGBAlpha });
 
 	//	プロパティの作成
+	info->showMetrics = Config::Current()->common.show_metrics;
 	auto property = Property(server);
-	InitProperty(property);
+	InitProperty(property, info->showMetrics);
 	initialize.SetProperty(property);
 
 	// 初回は0番設定に
@@ -301,26 +372,259 @@ inline Block ImageToBlock(const Image& image, int x, int y) {
 }
 
 
+/// 転送速度のログ（トレースと統計にも残す）
+/// @param label 処理名（文字列リテラルのみ）
+/// @param start 開始時刻
+/// @param pixels 処理したピクセル数
+static void PrintThroughput(const char* label, std::chrono::steady_clock::time_point start, int64_t pixels) {
+	const auto end = std::chrono::steady_clock::now();
+	Trace::Complete(label, start, end, "pixels", pixels);
+	const std::chrono::duration<double> elapsed = end - start;
+	Metrics::Throughput(label, elapsed.count(), pixels);
+	const double seconds = std::max(elapsed.count(), 1e-9);
+	print("%s: %.2f ms, %.1f Mpix/s, %.2f ns/pix", label, seconds * 1e3, pixels / seconds * 1e-6, seconds * 1e9 / std::max<int64_t>(pixels, 1));
+}
+
+/// 矩形が同じか
+inline bool IsSameRect(const Rect& a, const Rect& b) {
+	return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+/// 入力画像の取り込み
+/// @param rect 選択範囲
+/// @param buffer 取り込み先（前回と同じ選択範囲なら内容が変わったブロックだけ取り込む）
+/// @param fill 透明部分を周りの色で埋めるか
+/// @note 中断された時はバッファはそのまま（run.Result()を確認すること）
+static void CaptureInput(Run& run, Offscreen& source, const Rect& rect, InputBuffer& buffer, bool fill) {
+	const auto width = rect.right - rect.left;
+	const auto height = rect.bottom - rect.top;
+	if (!buffer.image || !IsSameRect(buffer.rect, rect) || buffer.filled != fill) {
+		// 選択範囲（か穴埋めの有無）が変わったら作り直し
+		buffer.rect = rect;
+		buffer.image.emplace(width, height, 3);
+		if (fill) buffer.alpha.emplace(width, height, 1);
+		else buffer.alpha.reset();
+		buffer.filled = fill;
+		buffer.blockRects.clear();
+		buffer.blockHashes.clear();
+	} else if (!buffer.image->unique()) {
+		// 前回の画像を生成中のジョブがまだ持ってるかもしれないので複製してから書き換える
+		Image copy{ width, height, 3 };
+		memcpy(copy.data(), buffer.image->data(), copy.size());
+		buffer.image.emplace(copy);
+	}
+	Block block = ImageToBlock(*buffer.image, rect.left, rect.top);
+	Block alphaBlock = fill ? Block{
+		.rect{ rect }, .address{ buffer.alpha->data() }, .rowBytes{ width }, .pixelBytes{ 1 }, .r{0}, .g{0}, .b{0}, .needOffset{ true }
+	} : Block{};
+
+	// ブロックの取得はこのスレッドで（1ブロックに収まっていればホストに処理を返さない）
+	auto rects = source.GetBlockRects(rect);
+	std::vector<Block> blocks, alphaBlocks;
+	blocks.reserve(rects.size());
+	for (const auto& blockRect : rects) {
+		if (rects.size() > 1 && run.Process(Run::States::Continue) != Run::Results::Continue) return;
+		blocks.push_back(source.GetBlockImage(blockRect));
+		if (fill) alphaBlocks.push_back(source.GetBlockAlpha(blockRect));
+	}
+
+	// ブロック分割が前回と違えば全部取り込み直し
+	const bool fresh = !std::equal(rects.begin(), rects.end(), buffer.blockRects.begin(), buffer.blockRects.end(), IsSameRect);
+	if (fresh) {
+		buffer.blockRects = rects;
+		buffer.blockHashes.assign(rects.size(), 0);
+	}
+
+	// ハッシュが変わったブロックだけ転送（並列で）
+	const auto start = std::chrono::steady_clock::now();
+	std::atomic<int> copied{ 0 };
+	ParallelFor(blocks.size(), [&](size_t i) {
+		auto hash = HashBlock(blocks[i], rect);
+		if (fill) hash = Hash::Hasher()(hash)(HashBlock(alphaBlocks[i], rect)).value();
+		if (!fresh && buffer.blockHashes[i] == hash) return;
+		buffer.blockHashes[i] = hash;
+		Transfer(block, blocks[i]);
+		if (fill) Transfer(alphaBlock, alphaBlocks[i]);
+		++copied;
+	});
+	print("capture: %d / %d blocks", copied.load(), static_cast<int>(blocks.size()));
+	PrintThroughput("capture", start, static_cast<int64_t>(width) * height);
+
+	// 透明部分の穴埋め（変わったブロックがあれば全体をやり直す）
+	// @note 穴の所は毎回周りから作り直すので、埋めた後の画像に上書きで取り込んでも結果は同じ
+	if (fill && copied > 0) {
+		const auto fillStart = std::chrono::steady_clock::now();
+		StableDiffusion::FillTransparent(*buffer.image, *buffer.alpha);
+		PrintThroughput("fill transparent", fillStart, static_cast<int64_t>(width) * height);
+	}
+
+	Hash::Hasher hasher;
+	hasher(width)(height)(buffer.image->channel);
+	for (size_t i = 0; i < rects.size(); ++i) hasher(rects[i].left)(rects[i].top)(buffer.blockHashes[i]);
+	buffer.hash = hasher.value();
+}
+
+/// 矩形が空か
+inline bool IsEmptyRect(const Rect& rect) {
+	return rect.left >= rect.right || rect.top >= rect.bottom;
+}
+
+/// 矩形を広げて含める
+/// @param rect 広げる矩形（空なら含める矩形そのまま）
+/// @param other 含める矩形（空なら何もしない）
+static void UniteRect(Rect& rect, const Rect& other) {
+	if (IsEmptyRect(other)) return;
+	if (IsEmptyRect(rect)) { rect = other; return; }
+	rect.left = std::min(rect.left, other.left);
+	rect.top = std::min(rect.top, other.top);
+	rect.right = std::max(rect.right, other.right);
+	rect.bottom = std::max(rect.bottom, other.bottom);
+}
+
+/// マスクの島（繋がった選択部分）の取得
+/// @param selectArea 選択範囲のオフスクリーン
+/// @param rect 選択範囲
+/// @return 島毎に、選択されている所（マスクが0でない所）を囲む矩形（何も無ければ空）
+/// @note 粗いグリッドの8近傍で繋がりを見るので、セルより狭い隙間で分かれた島は一つになる
+static std::vector<Rect> GetMaskIslands(Run& run, Offscreen& selectArea, const Rect& rect) {
+	constexpr Int kCell = 32;
+	const Int cols = (rect.right - rect.left + kCell - 1) / kCell;
+	const Int rows = (rect.bottom - rect.top + kCell - 1) / kCell;
+	if (cols <= 0 || rows <= 0) return {};
+
+	// ブロックの取得（ホストのAPIはこのスレッドで）
+	std::vector<Block> blocks;
+	for (const auto& blockRect : selectArea.GetBlockRects(rect)) {
+		if (run.Process(Run::States::Continue) != Run::Results::Continue) return {};
+		blocks.push_back(selectArea.GetBlockSelectArea(blockRect));
+	}
+
+	// ブロックとセルの重なり毎に範囲を並列で探す（ブロックを跨ぐセルは後でまとめる）
+	struct Hit {
+		size_t cell;
+		Rect bounds;
+	};
+	std::vector<std::vector<Hit>> hits(blocks.size());
+	ParallelFor(blocks.size(), [&](size_t i) {
+		const auto& block = blocks[i];
+		const Int x0 = (std::max(block.rect.left, rect.left) - rect.left) / kCell;
+		const Int y0 = (std::max(block.rect.top, rect.top) - rect.top) / kCell;
+		const Int x1 = (std::min(block.rect.right, rect.right) - rect.left + kCell - 1) / kCell;
+		const Int y1 = (std::min(block.rect.bottom, rect.bottom) - rect.top + kCell - 1) / kCell;
+		for (Int y = y0; y < y1; ++y) {
+			for (Int x = x0; x < x1; ++x) {
+				const Rect cellRect = { rect.left + x * kCell, rect.top + y * kCell,
+					std::min(rect.left + (x + 1) * kCell, rect.right), std::min(rect.top + (y + 1) * kCell, rect.bottom) };
+				const auto bounds = MaskBounds(block, cellRect);
+				if (!IsEmptyRect(bounds)) hits[i].push_back(Hit{ static_cast<size_t>(y * cols + x), bounds });
+			}
+		}
+	});
+	std::vector<Rect> cells(static_cast<size_t>(cols) * rows, Rect{ 0, 0, 0, 0 });
+	for (const auto& blockHits : hits) {
+		for (const auto& hit : blockHits) UniteRect(cells[hit.cell], hit.bounds);
+	}
+
+	// 繋がったセルをまとめる
+	std::vector<Rect> islands;
+	std::vector<bool> visited(cells.size(), false);
+	std::vector<size_t> stack;
+	for (size_t start = 0; start < cells.size(); ++start) {
+		if (visited[start] || IsEmptyRect(cells[start])) continue;
+		Rect island = { 0, 0, 0, 0 };
+		visited[start] = true;
+		stack.push_back(start);
+		while (!stack.empty()) {
+			const auto cell = stack.back();
+			stack.pop_back();
+			UniteRect(island, cells[cell]);
+			const Int cx = static_cast<Int>(cell % cols), cy = static_cast<Int>(cell / cols);
+			for (Int y = std::max<Int>(cy - 1, 0); y <= std::min<Int>(cy + 1, rows - 1); ++y) {
+				for (Int x = std::max<Int>(cx - 1, 0); x <= std::min<Int>(cx + 1, cols - 1); ++x) {
+					const auto next = static_cast<size_t>(y * cols + x);
+					if (visited[next] || IsEmptyRect(cells[next])) continue;
+					visited[next] = true;
+					stack.push_back(next);
+				}
+			}
+		}
+		islands.push_back(island);
+	}
+	return islands;
+}
+
+/// 生成範囲の決定
+/// @param bounds マスクの範囲
+/// @param padding 周りに足す余白
+/// @param limit 選択範囲（ここからははみ出さない）
+/// @return 余白を足して64の倍数に広げた矩形（入りきらなければ選択範囲の幅まで）
+static Rect CropRect(const Rect& bounds, int padding, const Rect& limit) {
+	auto fit = [padding = std::max(padding, 0)](Int lo, Int hi, Int limitLo, Int limitHi, Int& outLo, Int& outHi) {
+		const Int size = std::min<Int>((hi - lo + padding * 2 + 63) / 64 * 64, limitHi - limitLo);
+		outLo = std::clamp<Int>((lo + hi - size) / 2, limitLo, limitHi - size);
+		outHi = outLo + size;
+	};
+	Rect result;
+	fit(bounds.left, bounds.right, limit.left, limit.right, result.left, result.right);
+	fit(bounds.top, bounds.bottom, limit.top, limit.bottom, result.top, result.bottom);
+	return result;
+}
+
+/// 島毎の生成範囲の決定
+/// @param islands 島毎のマスクの範囲
+/// @param padding 周りに足す余白
+/// @param limit 選択範囲（ここからははみ出さない）
+/// @return 島毎の生成範囲（広げた範囲が重なる島はまとめる、重なった所を上書きし合わないように）
+static std::vector<Rect> CropRects(std::vector<Rect> islands, int padding, const Rect& limit) {
+	// 細かい島が多すぎたら一つにまとめる（１枚ずつ生成すると却って遅い）
+	constexpr size_t kMaxIslands = 16;
+	if (islands.size() > kMaxIslands) {
+		Rect all = { 0, 0, 0, 0 };
+		for (const auto& island : islands) UniteRect(all, island);
+		islands = { all };
+	}
+
+	std::vector<Rect> rects;
+	for (;;) {
+		rects.clear();
+		for (const auto& island : islands) rects.push_back(CropRect(island, padding, limit));
+		bool merged = false;
+		for (size_t i = 0; i < rects.size() && !merged; ++i) {
+			for (size_t j = i + 1; j < rects.size() && !merged; ++j) {
+				const auto& a = rects[i];
+				const auto& b = rects[j];
+				if (a.left >= b.right || b.left >= a.right || a.top >= b.bottom || b.top >= a.bottom) continue;
+				UniteRect(islands[i], islands[j]);
+				islands.erase(islands.begin() + j);
+				merged = true;
+			}
+		}
+		if (!merged) return rects;
+	}
+}
+
 /// フィルタ実行
 /// @return 正常終了ならtrue
 static bool RunFilter(Server* server, Ptr* data) {
+	TRACE_SCOPE("RunFilter");
 	Run run(server);
 	auto info = static_cast<FilterInfo*>(*data);
 	info->server = server;
 
 	// 前回の設定で開く
 	Property property(server, run.GetProperty());
+	UpdateSettingList(property);
 	SwitchToSetting(info->setting, info->params, property);
 
-	// 生成ライブラリの初期化
-	StableDiffusion::Initialize(g_BasePath);
+	// 生成ライブラリの初期化（事前ロードで済んでいれば何もしない）
+	{
+		TRACE_SCOPE("initialize");
+		StableDiffusion::Initialize(g_BasePath, info->params);
+		StableDiffusion::ResultCache::Configure(g_BasePath + "cache", info->params);
+	}
 
 	// 選択範囲の取得
 	const auto selectAreaRect = run.GetSelectArea();
-	const auto width = selectAreaRect.right - selectAreaRect.left;
-	const auto height = selectAreaRect.bottom - selectAreaRect.top;
-	const auto offsetX = selectAreaRect.left;
-	const auto offsetY = selectAreaRect.top;
 
 	// オフスクリーンの取得
 	Offscreen offscreenSource(server), offscreenDestination(server), offscreenSelectArea(server);
@@ -328,68 +632,257 @@ static bool RunFilter(Server* server, Ptr* data) {
 	offscreenDestination.GetDestination();
 	offscreenSelectArea.GetSelectArea();
 
+	// 生成結果（生成範囲毎にbatch_count枚のバリエーション）
+	struct Region {
+		Rect rect;
+		std::vector<Image> results;
+	};
+	std::vector<Region> regions;
+	StableDiffusion::Params resultParams;
+	size_t variant = 0;
+
+	// マスクの島（mask_crop/mask_islandsの時だけ、マスクは実行中変わらないので一度だけ調べる）
+	std::optional<std::vector<Rect>> maskIslands;
+
+	// 書き出し
+	auto writeBack = [&](const Rect& targetRect, const Image& result) {
+		print("generated: %d * %d", result.width, result.height);
+		const auto width = targetRect.right - targetRect.left;
+		const auto height = targetRect.bottom - targetRect.top;
+		Block outputBlock = ImageToBlock(result, targetRect.left, targetRect.top);
+
+		// 転送先ブロックの取得（ホストのAPIはこのスレッドで）
+		struct Target {
+			Rect rect;
+			Block image, alpha, select;
+		};
+		std::vector<Target> targets;
+		auto destRects = offscreenDestination.GetBlockRects(targetRect);
+		targets.reserve(destRects.size());
+		for (const auto& rect : destRects) {
+			if (run.Process(Run::States::Continue) != Run::Results::Continue) return;
+			targets.push_back(Target{ rect, offscreenDestination.GetBlockImage(rect), offscreenDestination.GetBlockAlpha(rect),
+				offscreenSelectArea ? offscreenSelectArea.GetBlockSelectArea(rect) : Block{} });
+		}
+
+		// ブロック転送（ブロック同士は重ならないので並列で）
+		const auto start = std::chrono::steady_clock::now();
+		ParallelFor(targets.size(), [&](size_t i) {
+			const auto& target = targets[i];
+			if (offscreenSelectArea) {
+				// 選択範囲（マスク）付きで描画
+				Transfer(target.image, outputBlock, target.alpha, target.select);
+			} else {
+				// 選択範囲なしで描画（透明ピクセルは埋めない）
+				Transfer(target.image, outputBlock, target.alpha);
+			}
+		});
+		PrintThroughput("write back", start, static_cast<int64_t>(width) * height);
+		for (const auto& target : targets) run.UpdateRect(target.rect);
+	};
+
+	// 生成
+	// @note 生成はワーカースレッドで、こっちはホストに処理を返しながら進捗を反映する
+	// @note 中断（リスタートか終了）されたら空を返すので、呼び出し側でrun.Result()を確認すること
+	auto wait = [&run](std::shared_ptr<StableDiffusion::Job> job) {
+		TRACE_SCOPE("wait");
+		int total = job->steps, done = 0;
+		run.Total(total);
+		while (!job->Wait(std::chrono::milliseconds(16))) {
+			if (run.Process(Run::States::Continue) != Run::Results::Continue) {
+				job->Cancel();
+				return std::vector<Image>{};
+			}
+			const int steps = job->steps, step = job->step;
+			if (steps != total) run.Total(total = steps); // タイル分割の時は増える
+			if (step != done) run.Progress(done = step);
+		}
+		// 統計は使われる結果の分だけ（捨てられた投機的生成や中断されたジョブは数えない）
+		if (!job->Results().empty()) Metrics::Steps(job->StepSeconds());
+		return job->Results();
+	};
+	// まとめて生成（ジョブを全部積んで、ワーカーの同じコンテキストで続けて処理させる）
+	// @note 中断されたら残りのジョブも中断して、そこまでの結果を返す
+	auto generate = [&wait](const std::vector<StableDiffusion::Params>& params, const std::vector<Image>& inputImages) {
+		std::vector<std::shared_ptr<StableDiffusion::Job>> jobs;
+		for (size_t i = 0; i < params.size(); ++i) jobs.push_back(StableDiffusion::GenerateAsync(params[i], inputImages[i]));
+		std::vector<std::vector<Image>> results;
+		for (const auto& job : jobs) {
+			results.push_back(wait(job));
+			if (job->cancelled) break;
+		}
+		for (const auto& job : jobs) job->Cancel();
+		results.resize(jobs.size());
+		return results;
+	};
+
 	// メイン処理
 	while (true) {
 		if (run.Process(Run::States::Start) == Run::Results::Exit) break;
+		const auto runStart = std::chrono::steady_clock::now();
+		Metrics::BeginRun();
 
 		// パラメータの取得
 		auto params = info->params;
-		if (params.prompt.empty()) { print("empty prompt!"); return false; }
-		if (params.model_path.empty()) { print("empty model_path!"); return false; }
-		run.Total(params.sample_steps);
-
-		// 入力画像の取得
-		Image inputImage = Image{ width, height, 3 };
-		Block inputBlock = ImageToBlock(inputImage, offsetX, offsetY);
-		auto sourceRects = offscreenSource.GetBlockRects(selectAreaRect);
-		for (const auto& rect : sourceRects) {
-			if (run.Process(Run::States::Continue) != Run::Results::Continue) break;
-			Block srcBlock = offscreenSource.GetBlockImage(rect);
-			Transfer(inputBlock, srcBlock);
+		if (params.prompt.empty()) { print(LOG_ERROR, "empty prompt!"); return false; }
+		if (params.model_path.empty()) { print(LOG_ERROR, "empty model_path!"); return false; }
+
+		// 生成範囲の決定
+		std::vector<Rect> rects{ selectAreaRect };
+		if ((params.mask_crop || params.mask_islands) && offscreenSelectArea) {
+			if (!maskIslands) {
+				const auto start = std::chrono::steady_clock::now();
+				auto islands = GetMaskIslands(run, offscreenSelectArea, selectAreaRect);
+				if (run.Result() == Run::Results::Restart) continue;
+				if (run.Result() == Run::Results::Exit) break;
+				maskIslands = std::move(islands);
+				PrintThroughput("mask islands", start, static_cast<int64_t>(selectAreaRect.right - selectAreaRect.left) * (selectAreaRect.bottom - selectAreaRect.top));
+			}
+			if (maskIslands->empty()) { print(LOG_WARN, "empty mask!"); break; }
+			if (params.mask_islands) {
+				rects = CropRects(*maskIslands, params.mask_padding, selectAreaRect);
+			} else {
+				Rect bounds = { 0, 0, 0, 0 };
+				for (const auto& island : *maskIslands) UniteRect(bounds, island);
+				rects = { CropRect(bounds, params.mask_padding, selectAreaRect) };
+			}
 		}
-		if (run.Result() == Run::Results::Restart) continue;
-		if (run.Result() == Run::Results::Exit) break;
-
-		// 生成
-		params.width = width;
-		params.height = height;
-
-		print("generate by prompt: %s", params.prompt.c_str());
-		print("input image: %d * %d", width, height);
-		auto result = StableDiffusion::Generate(params, inputImage,
-			[&run](int step, int steps) { // 進捗コールバック
-				run.Progress(step);
-				print("Progress %d / %d", step, steps);
-			});
-
-		print("generated: %d * %d", result.width, result.height);
-		Block outputBlock = ImageToBlock(result, offsetX, offsetY);
 
-		// ブロック転送
-		auto destRects = offscreenDestination.GetBlockRects(selectAreaRect);
-		for (const auto& rect : destRects) {
-			if (run.Process(Run::States::Continue) != Run::Results::Continue) break;
+		if (!regions.empty() && regions.front().results.size() > 1 && params == resultParams) {
+			// 設定そのままのリスタートなら次のバリエーションを書き出すだけ
+			variant = (variant + 1) % regions.front().results.size();
+			print("variant: %d / %d", static_cast<int>(variant + 1), static_cast<int>(regions.front().results.size()));
+		} else {
+			run.Total(params.sample_steps);
+
+			// 入力画像の取得（t2iなら使わないので取り込まない）
+			const bool useInput = StableDiffusion::UsesInput(params);
+			info->inputs.resize(rects.size());
+			for (size_t i = 0; useInput && i < rects.size(); ++i) {
+				CaptureInput(run, offscreenSource, rects[i], info->inputs[i], params.fill_transparent);
+				if (run.Result() == Run::Results::Restart || run.Result() == Run::Results::Exit) break;
+			}
+			if (run.Result() == Run::Results::Restart) continue;
+			if (run.Result() == Run::Results::Exit) break;
+
+			// 生成範囲毎のパラメータ
+			std::vector<StableDiffusion::Params> regionParams;
+			std::vector<Image> inputImages;
+			std::vector<uint64_t> inputHashes, cacheKeys;
+			for (size_t i = 0; i < rects.size(); ++i) {
+				auto& p = regionParams.emplace_back(params);
+				p.width = rects[i].right - rects[i].left;
+				p.height = rects[i].bottom - rects[i].top;
+				inputImages.push_back(useInput ? *info->inputs[i].image : Image());
+				inputHashes.push_back(useInput ? info->inputs[i].hash : 0);
+				cacheKeys.push_back(StableDiffusion::ResultCache::MakeKey(p, inputHashes.back()));
+			}
 
-			// 転送先ブロック
-			Block imageBlock = offscreenDestination.GetBlockImage(rect);
-			Block alphaBlock = offscreenDestination.GetBlockAlpha(rect);
+			// 投機的生成は範囲が一つの時だけ
+			info->lastWidth = rects.size() == 1 ? regionParams.front().width : 0;
+			info->lastHeight = rects.size() == 1 ? regionParams.front().height : 0;
 
-			if (offscreenSelectArea) {
-				// 選択範囲ブロック
-				Block selectBlock = offscreenSelectArea.GetBlockSelectArea(rect);
+			// 裏で生成してたものがあれば引き継ぐ（一致しなければ中断される）
+			auto speculativeJob = rects.size() == 1 ? StableDiffusion::Speculative::Adopt(regionParams.front(), inputHashes.front()) : nullptr;
 
-				// 選択範囲（マスク）付きで描画
-				Transfer(imageBlock, outputBlock, alphaBlock, selectBlock);
+			// 同じ設定＆入力の結果が残っていれば生成しない
+			std::vector<std::vector<Image>> results(rects.size());
+			std::vector<size_t> pending;
+			for (size_t i = 0; i < rects.size(); ++i) {
+				results[i] = StableDiffusion::ResultCache::Find(cacheKeys[i]);
+				if (results[i].empty()) pending.push_back(i);
+			}
+			if (pending.empty()) {
+				if (speculativeJob) speculativeJob->Cancel();
+			} else if (speculativeJob) {
+				// 投機的生成の完了待ち
+				results.front() = wait(speculativeJob);
+				if (run.Result() == Run::Results::Restart) continue;
+				if (run.Result() == Run::Results::Exit) break;
+				StableDiffusion::ResultCache::Store(cacheKeys.front(), results.front());
 			} else {
-				// 選択範囲なしで描画（透明ピクセルは埋めない）
-				Transfer(imageBlock, outputBlock, alphaBlock);
+				print("generate by prompt: %s", params.prompt.c_str());
+				for (auto i : pending) {
+					print("input image: %d * %d (%d, %d)", regionParams[i].width, regionParams[i].height,
+						static_cast<int>(rects[i].left), static_cast<int>(rects[i].top));
+				}
+
+				// プレビュー（まず軽い設定で描いて見せてから本番）
+				if (params.preview) {
+					TRACE_SCOPE("preview");
+					std::vector<size_t> previewPending;
+					std::vector<StableDiffusion::Params> previewParams;
+					std::vector<Image> previewInputs;
+					std::vector<uint64_t> previewKeys;
+					std::vector<std::vector<Image>> previews;
+					for (auto i : pending) {
+						const auto& p = previewParams.emplace_back(StableDiffusion::PreviewParams(regionParams[i]));
+						previewInputs.push_back(inputImages[i]);
+						previewKeys.push_back(StableDiffusion::ResultCache::MakeKey(p, inputHashes[i]));
+						previews.push_back(StableDiffusion::ResultCache::Find(previewKeys.back()));
+						if (previews.back().empty()) previewPending.push_back(previews.size() - 1);
+					}
+					if (!previewPending.empty()) {
+						std::vector<StableDiffusion::Params> jobParams;
+						std::vector<Image> jobInputs;
+						for (auto k : previewPending) {
+							jobParams.push_back(previewParams[k]);
+							jobInputs.push_back(previewInputs[k]);
+						}
+						auto generated = generate(jobParams, jobInputs);
+						if (run.Result() == Run::Results::Restart) continue;
+						if (run.Result() == Run::Results::Exit) break;
+						for (size_t k = 0; k < previewPending.size(); ++k) {
+							previews[previewPending[k]] = std::move(generated[k]);
+							StableDiffusion::ResultCache::Store(previewKeys[previewPending[k]], previews[previewPending[k]]);
+						}
+					}
+					for (size_t k = 0; k < pending.size(); ++k) {
+						if (previews[k].empty()) continue;
+						writeBack(rects[pending[k]], previews[k].front());
+						if (run.Result() == Run::Results::Restart || run.Result() == Run::Results::Exit) break;
+					}
+					if (run.Result() == Run::Results::Restart) continue;
+					if (run.Result() == Run::Results::Exit) break;
+				}
+
+				// 生成
+				std::vector<StableDiffusion::Params> jobParams;
+				std::vector<Image> jobInputs;
+				for (auto i : pending) {
+					jobParams.push_back(regionParams[i]);
+					jobInputs.push_back(inputImages[i]);
+				}
+				auto generated = generate(jobParams, jobInputs);
+				if (run.Result() == Run::Results::Restart) continue;
+				if (run.Result() == Run::Results::Exit) break;
+				for (size_t k = 0; k < pending.size(); ++k) {
+					results[pending[k]] = std::move(generated[k]);
+					StableDiffusion::ResultCache::Store(cacheKeys[pending[k]], results[pending[k]]);
+				}
+			}
+			regions.clear();
+			for (size_t i = 0; i < rects.size(); ++i) {
+				if (!results[i].empty()) regions.push_back(Region{ rects[i], std::move(results[i]) });
 			}
+			resultParams = params;
+			variant = 0;
+			if (regions.empty()) break;
+		}
 
-			run.UpdateRect(rect);
+		// 書き出し
+		for (const auto& region : regions) {
+			writeBack(region.rect, region.results[variant % region.results.size()]);
+			if (run.Result() == Run::Results::Restart || run.Result() == Run::Results::Exit) break;
 		}
 		if (run.Result() == Run::Results::Restart) continue;
 		if (run.Result() == Run::Results::Exit) break;
 
+		// 統計（書き出しまで済んだ実行だけ数える）
+		Metrics::EndRun(std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count());
+		print("%s", Metrics::Summary().c_str());
+		if (info->showMetrics) property.setString(ITEM_METRICS, Metrics::Summary());
+
 		// 継続確認
 		if (run.Process(Run::States::End) != Run::Results::Restart) break;
 	}
@@ -437,7 +930,11 @@ extern "C" __declspec(dllexport) void TriglavPluginCall(CallResult* result, Ptr*
 	case Selector::FilterRun:
 		print("RunFilter {");
 		if (!server->recordSuite.filterRunRecord) return;
-		if (!RunFilter(server, data)) return;
+		{
+			const bool succeeded = RunFilter(server, data);
+			Trace::Flush(); // 実行毎に書き出す（終了まで待つと落ちた時に残らない）
+			if (!succeeded) return;
+		}
 		print("RunFilter }");
 		break;
 	}
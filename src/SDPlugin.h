@@ -6,6 +6,17 @@
  */
 #pragma once
 
-/// デバッグ出力
+/// ログレベル（小さいほど重要）
+enum LogLevel {
+	LOG_ERROR,
+	LOG_WARN,
+	LOG_INFO,
+	LOG_DEBUG,
+};
+
+/// デバッグ出力（LOG_INFO）
 extern void print(const char* format, ...);
 
+/// デバッグ出力（レベル指定）
+extern void print(LogLevel level, const char* format, ...);
+
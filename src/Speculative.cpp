@@ -0,0 +1,128 @@
+/**
+ * @file Speculative.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 投機的生成（プロパティを編集している間に裏で生成しておく）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Speculative.h"
+
+namespace StableDiffusion::Speculative {
+	/// @brief 投機的生成のリクエスト
+	struct Pending {
+		Params params;
+		Image input;
+		uint64_t inputHash;
+		std::chrono::steady_clock::time_point deadline;
+	};
+
+	static std::thread speculativeThread;
+	static std::mutex speculativeMutex;
+	static std::condition_variable speculativeCondition;
+	static std::optional<Pending> speculativePending;
+	static std::shared_ptr<Job> speculativeJob;
+	static std::shared_ptr<Job> speculativeCancelled; // 中断したけどまだ終わってないジョブ（終わるまで次を始めない）
+	static uint64_t speculativeInputHash;
+	static bool speculativeExit;
+
+	/// 生成中のものと同じ生成になるか
+	static bool IsSameRequest(const Params& params, uint64_t inputHash) {
+		return speculativeJob && !speculativeJob->cancelled && speculativeJob->params == params && speculativeInputHash == inputHash;
+	}
+
+	/// 投機的生成のワーカースレッド
+	/// @note 締め切りまでに次のリクエストが来たら待ち直す（デバウンス）
+	static void SpeculativeWorker() {
+		std::unique_lock lock(speculativeMutex);
+		while (true) {
+			speculativeCondition.wait(lock, [] { return speculativeExit || speculativePending; });
+			if (speculativeExit) return;
+			const auto deadline = speculativePending->deadline;
+			if (speculativeCondition.wait_until(lock, deadline, [] { return speculativeExit; })) return;
+			if (!speculativePending || std::chrono::steady_clock::now() < speculativePending->deadline) continue;
+
+			// 中断したジョブが残ってる間は始めない（キューに積むと本番の生成がその後ろで待つ）
+			if (speculativeCancelled) {
+				const auto cancelled = speculativeCancelled;
+				lock.unlock();
+				const bool done = cancelled->Wait(std::chrono::milliseconds(100));
+				lock.lock();
+				if (done && speculativeCancelled == cancelled) speculativeCancelled.reset();
+				continue;
+			}
+
+			print("speculative: start");
+			speculativeJob = GenerateAsync(speculativePending->params, speculativePending->input);
+			speculativeInputHash = speculativePending->inputHash;
+			speculativePending.reset();
+		}
+	}
+
+	/// 中断（終わるまでは次の投機的生成を始めない）
+	static void CancelJob(std::shared_ptr<Job> job) {
+		job->Cancel();
+		speculativeCancelled = std::move(job);
+	}
+
+	/// リクエスト
+	void Request(const Params& params, const Image& input, uint64_t inputHash) {
+		// 中断できないバックエンドだと、外れた投機的生成が最後まで走って本番の生成を待たせるので使わない
+		if (!CanCancel()) {
+			static std::atomic<bool> warned;
+			if (!warned.exchange(true)) print(LOG_WARN, "speculative: skipped (backend not loaded yet, or it cannot cancel a running generation)");
+			return;
+		}
+
+		std::lock_guard lock(speculativeMutex);
+		if (speculativeExit) return;
+
+		// 生成中のものと同じなら何もしない（違えば中断して差し替え）
+		if (speculativeJob) {
+			if (IsSameRequest(params, inputHash)) {
+				speculativePending.reset();
+				return;
+			}
+			CancelJob(std::move(speculativeJob));
+		}
+
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(params.speculative_delay_ms, 0));
+		speculativePending.emplace(Pending{ params, input, inputHash, deadline });
+		if (!speculativeThread.joinable()) {
+			speculativeThread = std::thread(SpeculativeWorker);
+		}
+		speculativeCondition.notify_one();
+	}
+
+	/// 採用
+	std::shared_ptr<Job> Adopt(const Params& params, uint64_t inputHash) {
+		std::lock_guard lock(speculativeMutex);
+		speculativePending.reset();
+		const bool same = IsSameRequest(params, inputHash);
+		auto job = std::move(speculativeJob);
+		speculativeJob.reset();
+		if (!job) return nullptr;
+		if (same) {
+			print("speculative: adopted");
+			return job;
+		}
+		CancelJob(std::move(job));
+		return nullptr;
+	}
+
+	/// 停止
+	void Terminate() {
+		{
+			std::lock_guard lock(speculativeMutex);
+			speculativeExit = true;
+			speculativePending.reset();
+			if (speculativeJob) speculativeJob->Cancel();
+			speculativeJob.reset();
+			speculativeCancelled.reset();
+		}
+		speculativeCondition.notify_one();
+		if (speculativeThread.joinable()) speculativeThread.join();
+		std::lock_guard lock(speculativeMutex);
+		speculativeExit = false;
+	}
+}
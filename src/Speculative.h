@@ -0,0 +1,27 @@
+/**
+ * @file Speculative.h
+ * @author 青猫 (AonekoSS)
+ * @brief 投機的生成（プロパティを編集している間に裏で生成しておく）
+ * @note 編集が止まってしばらくしたら生成を始めて、OK時に設定が一致していればその結果を使う
+ */
+#pragma once
+
+#include "StableDiffusion.h"
+
+namespace StableDiffusion::Speculative {
+	/// リクエスト
+	/// @param params 生成パラメータ（speculative_delay_msだけ待ってから生成する）
+	/// @param input 入力画像
+	/// @param inputHash 入力画像のハッシュ（一致判定に使う）
+	/// @note 新しいリクエストが来たら古いものは中断して差し替える
+	extern void Request(const Params& params, const Image& input, uint64_t inputHash);
+
+	/// 採用
+	/// @param params 生成パラメータ
+	/// @param inputHash 入力画像のハッシュ
+	/// @return 設定と入力が一致する生成中か生成済みのジョブ（無ければnullptr、一致しないジョブは中断する）
+	extern std::shared_ptr<Job> Adopt(const Params& params, uint64_t inputHash);
+
+	/// 停止（生成中のジョブは中断してスレッドを止める）
+	extern void Terminate();
+}
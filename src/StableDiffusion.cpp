@@ -7,125 +7,476 @@
 
 #include "SDPlugin.h"
 #include "StableDiffusion.h"
+#include "ImageProcess.h"
+#include "IniFile.h"
+#include "ParamsTable.h"
+#include "Trace.h"
+#include "Metrics.h"
 
 namespace StableDiffusion {
-	/// @brief DLLのモジュールハンドル
-	static HMODULE hModule;
+	/// @brief 生成バックエンド（DLLかスタブ）
+	static Backend backend;
 
-	// DLL各関数のポインタ
-#define DECL_FUNCTION(function) static decltype(::function)* function
+	/// @brief バックエンドのロード周りの排他
+	static std::mutex libraryMutex;
 
-	DECL_FUNCTION(new_sd_ctx);
-	DECL_FUNCTION(free_sd_ctx);
-	DECL_FUNCTION(img2img);
-	DECL_FUNCTION(txt2img);
-	DECL_FUNCTION(get_num_physical_cores);
-	DECL_FUNCTION(sd_type_name);
-	DECL_FUNCTION(sd_set_log_callback);
-	DECL_FUNCTION(sd_set_progress_callback);
+	/// @brief 詳細ログを出すか（ログコールバック用）
+	static std::atomic<bool> verboseLog;
 
-#define BIND_FUNCTION(function)  function=reinterpret_cast<decltype(function)>(GetProcAddress(hModule, #function))
+	/// ログ用コールバック
+	static void log_callback(enum sd_log_level_t level, const char* log, void* data) {
+		if (!log || (!verboseLog && level <= SD_LOG_DEBUG)) return;
+		LogLevel logLevel = LOG_INFO;
+		switch (level) {
+		case SD_LOG_DEBUG: logLevel = LOG_DEBUG; break;
+		case SD_LOG_INFO:  logLevel = LOG_INFO;  break;
+		case SD_LOG_WARN:  logLevel = LOG_WARN;  break;
+		case SD_LOG_ERROR: logLevel = LOG_ERROR; break;
+		}
+		print(logLevel, "sd: %s", log); // レベルのタグはLoggerで付く
+	}
 
 	/// ライブラリ初期化
 	/// @param base_path DLLを探しに行くベースパス
-	void Initialize(std::string const& base_path) {
-		if (hModule != NULL) return;
-
-		// DLLのロード
-		auto dll_path = base_path + "stable-diffusion.dll";
-		print("LoadLibrary: %s", dll_path.c_str());
-		hModule = LoadLibraryA(dll_path.c_str());
-		if (hModule == NULL) {
-			print("LoadLibrary: error");
+	/// @param params 生成パラメータ（バックエンドの選択に使う）
+	void Initialize(std::string const& base_path, const Params& params) {
+		std::lock_guard lock(libraryMutex);
+		if (backend) return;
+
+		// バックエンドのロード
+		if (params.backend == "stub") {
+			LoadStubBackend(backend, params.stub_step_ms, params.stub_load_ms);
+		} else if (!LoadLibraryBackend(backend, base_path)) {
 			return;
 		}
 
-		// 各関数のバインディング
-		BIND_FUNCTION(new_sd_ctx);
-		BIND_FUNCTION(free_sd_ctx);
-		BIND_FUNCTION(img2img);
-		BIND_FUNCTION(txt2img);
-		BIND_FUNCTION(get_num_physical_cores);
-		BIND_FUNCTION(sd_type_name);
-		BIND_FUNCTION(sd_set_log_callback);
-		BIND_FUNCTION(sd_set_progress_callback);
+		// ログはモデルのロード中から拾いたいのでここで設定
+		backend.sd_set_log_callback(log_callback, nullptr);
 	}
 
-	/// ライブラリ解放
-	void Terminate() {
-		if (hModule != NULL) FreeLibrary(hModule);
-		hModule = NULL;
+	/// ライブラリがロード済みか
+	static bool IsInitialized() {
+		std::lock_guard lock(libraryMutex);
+		return static_cast<bool>(backend);
 	}
 
-	/// ログ用コールバック
-	static void log_callback(enum sd_log_level_t level, const char* log, void* data) {
-		Params* params = (Params*)data;
-		if (!log || !params || (!params->verbose && level <= SD_LOG_DEBUG)) return;
-		const char* level_name = "????";
-		switch (level) {
-		case SD_LOG_DEBUG: level_name = "DEBUG"; break;
-		case SD_LOG_INFO:  level_name = "INFO";  break;
-		case SD_LOG_WARN:  level_name = "WARN";  break;
-		case SD_LOG_ERROR: level_name = "ERROR"; break;
+	// 生成を途中で中断できるか
+	bool CanCancel() {
+		std::lock_guard lock(libraryMutex);
+		return backend && backend.cancel;
+	}
+
+	/// @brief コンテキスト周りの排他
+	/// @note プールの出し入れの間だけ持つ（モデルのロード中は持たない）
+	static std::mutex contextMutex;
+
+	/// @brief ロードが終わった時の通知（同じモデルをロード中なら終わるのを待ってそのまま使う）
+	static std::condition_variable contextLoaded;
+
+	/// @brief 常駐コンテキスト
+	struct ContextEntry {
+		Params params;
+		std::shared_ptr<sd_ctx_t> context; // ロード中はnullptr
+		uint64_t bytes;
+		bool loading;
+	};
+
+	/// @brief 常駐コンテキストのプール（先頭ほど最近使ったもの）
+	/// @note モデルのロードが重いので同じモデル設定なら使い回す
+	static std::list<ContextEntry> contextPool;
+
+	// プールの統計（ヒット、ミス、追い出し）
+	static int poolHits, poolMisses, poolEvictions;
+
+	/// モデル関係のパラメータが一致するか（コンテキストの使い回し判定用）
+	static bool IsSameModel(const Params& a, const Params& b) {
+		return !(ParamsTable::DiffFields(a, b) & ParamsTable::MODEL);
+	}
+
+	/// コンテキスト用のパラメータ（スレッド数の解決）
+	static Params ContextParams(const Params& params) {
+		auto p = params;
+		if (p.n_threads <= 0) {
+			p.n_threads = backend.get_num_physical_cores();
 		}
-		print("[%-5s] %s", level_name, log);
+		return p;
 	}
 
-	// iniファイル読み込みヘルパー（文字列用）
-	static std::string iniGetString(const std::string& filePath, const std::string& section, const std::string& key){
-		char buf[MAX_PATH] = {};
-		GetPrivateProfileStringA(section.c_str(), key.c_str(), "", buf, MAX_PATH, filePath.c_str());
-		auto text = std::string(buf);
+	/// モデルのメモリ使用量の見積もり（ファイルサイズの合計）
+	static uint64_t EstimateModelBytes(const Params& params) {
+		uint64_t bytes = 0;
+		for (const auto* path : {
+			&params.model_path, &params.clip_l_path, &params.clip_g_path, &params.t5xxl_path,
+			&params.diffusion_model_path, &params.vae_path, &params.taesd_path, &params.controlnet_path }) {
+			if (path->empty()) continue;
+			std::error_code ec;
+			auto size = std::filesystem::file_size(*path, ec);
+			if (!ec) bytes += size;
+		}
+		return bytes;
+	}
+
+	/// プールの状態をログに
+	static void PrintPoolStatus(const char* event) {
+		uint64_t bytes = 0;
+		for (const auto& entry : contextPool) bytes += entry.bytes;
+		print("sd::context: %s (hits=%d misses=%d evictions=%d resident=%d %lluMB)",
+			event, poolHits, poolMisses, poolEvictions,
+			static_cast<int>(contextPool.size()), static_cast<unsigned long long>(bytes >> 20));
+	}
+
+	/// コンテキストが生成で使われているか（プール以外からも参照されている）
+	static bool IsInUse(const ContextEntry& entry) {
+		return entry.context.use_count() > 1;
+	}
+
+	/// @brief プールから外したコンテキスト（解放は重いのでロックを外してから）
+	using Evicted = std::vector<std::shared_ptr<sd_ctx_t>>;
+
+	/// 上限に収まるまで古いのから捨てる
+	/// @param bytes これからロードする分
+	/// @param evictInUse 生成中のものも捨てるか（生成が終わった時点で解放される）、falseなら収まらない時は何も捨てない
+	/// @param evicted 外したコンテキストの行き先
+	/// @return 上限に収まったらtrue（ロード中のものは捨てられないので収まらないこともある）
+	static bool EvictForLoad(const Params& params, uint64_t bytes, bool evictInUse, Evicted& evicted) {
+		const auto maxModels = static_cast<size_t>(std::max(params.max_resident_models, 1));
+		const auto maxBytes = static_cast<uint64_t>(std::max(params.model_memory_mb, 0)) << 20;
+		size_t count = contextPool.size();
+		uint64_t total = bytes;
+		for (const auto& entry : contextPool) total += entry.bytes;
+		auto fits = [&] { return count < maxModels && (!maxBytes || total <= maxBytes); };
+
+		// 捨てるものを古い方から選ぶ
+		std::vector<std::list<ContextEntry>::iterator> victims;
+		for (auto it = contextPool.end(); !fits() && it != contextPool.begin();) {
+			--it;
+			if (it->loading || (!evictInUse && IsInUse(*it))) continue;
+			victims.push_back(it);
+			--count;
+			total -= it->bytes;
+		}
+		if (!fits() && !evictInUse) return false;
+
+		for (const auto it : victims) {
+			print("sd::context: evict %s", it->params.model_path.c_str());
+			evicted.push_back(std::move(it->context));
+			contextPool.erase(it);
+			++poolEvictions;
+		}
+		return fits();
+	}
+
+	/// コンテキストの取得
+	/// @param params 生成パラメータ（n_threadsは解決済みのもの）
+	/// @param preload 事前ロードか（生成中のものは追い出さない、場所が空かなければロードしない）
+	/// @return コンテキスト（失敗時は空）
+	/// @note 使われなくなったものから追い出す（max_resident_models、model_memory_mbで上限設定）
+	/// @note free_params_immediatelyが有効ならキャッシュせず使い捨てにする
+	/// @note ロード中はロックを持たないので、別のモデルの生成や追い出しはロードを待たない
+	static std::shared_ptr<sd_ctx_t> AcquireContext(const Params& params, bool preload = false) {
+		TRACE_SCOPE("acquire context");
+		Evicted evicted; // ロックより先に作って、ロックを外した後に解放されるように
+		std::unique_lock lock(contextMutex);
+		while (true) {
+			auto found = std::find_if(contextPool.begin(), contextPool.end(),
+				[&params](const ContextEntry& entry) { return IsSameModel(entry.params, params); });
+			if (found == contextPool.end()) break;
+			if (found->loading) {
+				// 同じモデルをロード中なら終わるのを待つ（失敗していたら探し直してロードする）
+				contextLoaded.wait(lock);
+				continue;
+			}
+			contextPool.splice(contextPool.begin(), contextPool, found);
+			++poolHits;
+			PrintPoolStatus("hit");
+			return found->context;
+		}
+
+		// 上限に収まるまで古いのから捨てる（メモリが足りなくなるので先に）
+		const auto bytes = EstimateModelBytes(params);
+		if (!EvictForLoad(params, bytes, !preload, evicted) && preload) {
+			print("sd::context: no room to preload %s", params.model_path.c_str());
+			return nullptr;
+		}
+		++poolMisses;
+
+		// ロード中の印を入れてからロックを外してロード
+		const bool pooled = !params.free_params_immediately;
+		auto entry = pooled ? contextPool.insert(contextPool.begin(), ContextEntry{ params, nullptr, bytes, true }) : contextPool.end();
+		lock.unlock();
+		evicted.clear(); // メモリを空けてからロード
+
+		const auto loadStart = Trace::Clock::now();
+		auto sd_ctx = backend.new_sd_ctx(
+			params.model_path.c_str(),
+			params.clip_l_path.c_str(),
+			params.clip_g_path.c_str(),
+			params.t5xxl_path.c_str(),
+			params.diffusion_model_path.c_str(),
+			params.vae_path.c_str(),
+			params.taesd_path.c_str(),
+			params.controlnet_path.c_str(),
+			params.lora_model_dir.c_str(),
+			params.embeddings_path.c_str(),
+			params.stacked_id_embeddings_path.c_str(),
+			params.vae_decode_only,
+			params.vae_tiling,
+			params.free_params_immediately,
+			params.n_threads,
+			params.wtype,
+			params.rng_type,
+			params.schedule,
+			params.clip_on_cpu,
+			params.control_net_cpu,
+			params.vae_on_cpu);
+		const auto loadEnd = Trace::Clock::now();
+		Trace::Complete("load model", loadStart, loadEnd);
+		std::shared_ptr<sd_ctx_t> context;
+		if (sd_ctx) {
+			Metrics::ContextLoad(std::chrono::duration<double>(loadEnd - loadStart).count());
+			context = std::shared_ptr<sd_ctx_t>(sd_ctx, backend.free_sd_ctx);
+		}
+		if (!pooled) return context;
 
-		// コメント削除
-		auto commentPos = text.find_first_of("#;");
-		if (commentPos != std::string::npos) {
-			text.erase(commentPos);
+		// 印を本物に差し替え（失敗なら外す）、待っている方に通知
+		lock.lock();
+		if (context) {
+			entry->context = context;
+			entry->loading = false;
+			PrintPoolStatus("miss");
+		} else {
+			contextPool.erase(entry);
 		}
+		lock.unlock();
+		contextLoaded.notify_all();
+		return context;
+	}
+
+	/// 使われなくなったモデルの解放
+	/// @note ロックは外すものを選ぶ間だけ（解放はロックを外してから）
+	void RetainModels(const std::vector<Params>& params) {
+		if (!IsInitialized()) return;
+
+		// 常駐コンテキストはn_threads解決済みなので合わせて比べる
+		std::vector<Params> keep;
+		for (const auto& p : params) keep.push_back(ContextParams(p));
 
-		// アンクォート
-		if (text.length() >= 2 && text.front() == '"' && text.back() == '"') {
-			text = text.substr(1, text.length() - 2);
+		Evicted evicted;
+		std::lock_guard lock(contextMutex);
+		for (auto it = contextPool.begin(); it != contextPool.end();) {
+			// ロード中のものはロードした側に任せる
+			if (it->loading || std::any_of(keep.begin(), keep.end(), [&it](const Params& p) { return IsSameModel(it->params, p); })) {
+				++it;
+				continue;
+			}
+			print("sd::context: evict %s (config changed)", it->params.model_path.c_str());
+			evicted.push_back(std::move(it->context));
+			it = contextPool.erase(it);
+			++poolEvictions;
 		}
-		return text;
+		if (!evicted.empty()) PrintPoolStatus("retain");
+	}
+
+	// 事前ロード用のワーカー
+	static std::thread preloadThread;
+	static std::mutex preloadMutex;
+	static std::condition_variable preloadCondition;
+	static std::optional<std::pair<std::string, Params>> preloadRequest;
+	static bool preloadExit;
+
+	/// 事前ロードのワーカースレッド
+	/// @note 溜まってたリクエストは最新のものだけ処理する
+	static void PreloadWorker() {
+		while (true) {
+			std::pair<std::string, Params> request;
+			{
+				std::unique_lock lock(preloadMutex);
+				preloadCondition.wait(lock, [] { return preloadExit || preloadRequest; });
+				if (preloadExit) return;
+				request = std::move(*preloadRequest);
+				preloadRequest.reset();
+			}
+			const auto& [base_path, params] = request;
+
+			Initialize(base_path, params);
+			if (!IsInitialized()) continue;
+
+			print("preload: %s", params.model_path.c_str());
+			auto context = AcquireContext(ContextParams(params), true);
+			print("preload: %s", context ? "done" : "skipped");
+		}
+	}
+
+	/// 事前ロード
+	/// @param base_path DLLを探しに行くベースパス
+	/// @param params 生成パラメータ（モデル関係だけ使う）
+	void Preload(const std::string& base_path, const Params& params) {
+		if (!params.preload || params.free_params_immediately || params.model_path.empty()) return;
+		std::lock_guard lock(preloadMutex);
+		if (preloadExit) return;
+		preloadRequest.emplace(base_path, params);
+		if (!preloadThread.joinable()) {
+			preloadThread = std::thread(PreloadWorker);
+		}
+		preloadCondition.notify_one();
+	}
+
+	// 生成用のワーカー
+	static std::thread generateThread;
+	static std::mutex generateMutex;
+	static std::condition_variable generateCondition;
+	static std::deque<std::shared_ptr<Job>> generateQueue;
+	static std::shared_ptr<Job> generateCurrent;
+	static bool generateExit;
+
+	/// 生成のワーカースレッド
+	/// @note 中断されたジョブは生成せずに空の結果で完了させる
+	static void GenerateWorker() {
+		while (true) {
+			{
+				std::unique_lock lock(generateMutex);
+				generateCurrent.reset();
+				generateCondition.wait(lock, [] { return generateExit || !generateQueue.empty(); });
+				if (generateExit) return;
+				generateCurrent = generateQueue.front();
+				generateQueue.pop_front();
+			}
+			auto& job = *generateCurrent;
+			if (job.cancelled) {
+				job.Finish({});
+				continue;
+			}
+			std::vector<float> stepSeconds;
+			auto results = Generate(job.params, job.input, [&job](int step, int steps) {
+				job.step = step;
+				job.steps = steps;
+				print(LOG_DEBUG, "Progress %d / %d", step, steps);
+				return !job.cancelled;
+			}, &stepSeconds);
+			job.Finish(std::move(results), std::move(stepSeconds));
+		}
+	}
+
+	/// 非同期の画像生成
+	/// @param params 生成パラメータ
+	/// @param input 入力画像
+	std::shared_ptr<Job> GenerateAsync(const Params& params, const Image& input) {
+		auto job = std::make_shared<Job>(params, input);
+		std::lock_guard lock(generateMutex);
+		if (generateExit) {
+			job->Finish({});
+			return job;
+		}
+		generateQueue.push_back(job);
+		if (!generateThread.joinable()) {
+			generateThread = std::thread(GenerateWorker);
+		}
+		generateCondition.notify_one();
+		return job;
+	}
+
+	/// ライブラリ解放
+	void Terminate() {
+		// 生成の停止（中断できないバックエンドなら今のジョブが終わるまで待つ）
+		{
+			std::lock_guard lock(generateMutex);
+			generateExit = true;
+			if (generateCurrent) generateCurrent->Cancel();
+			for (auto& job : generateQueue) job->Finish({});
+			generateQueue.clear();
+		}
+		generateCondition.notify_one();
+		if (generateThread.joinable()) generateThread.join();
+		{
+			std::lock_guard lock(generateMutex);
+			generateExit = false;
+		}
+
+		// 事前ロードの停止（new_sd_ctxは中断できないので、ロード中なら終わるまで待ってからDLLを解放する）
+		{
+			std::lock_guard lock(preloadMutex);
+			preloadExit = true;
+			preloadRequest.reset();
+		}
+		preloadCondition.notify_one();
+		if (preloadThread.joinable()) preloadThread.join();
+		{
+			std::lock_guard lock(preloadMutex);
+			preloadExit = false;
+		}
+
+		// コンテキストはDLLより先に解放（ロックはプールから外す間だけ）
+		std::list<ContextEntry> released;
+		{
+			std::lock_guard lock(contextMutex);
+			if (!contextPool.empty()) PrintPoolStatus("release");
+			released.swap(contextPool);
+		}
+		released.clear();
+
+		std::lock_guard lock(libraryMutex);
+		FreeBackend(backend);
+	}
+
+	// iniファイル読み込みヘルパー（文字列用）
+	static const std::string& iniGetString(const IniFile::Table& table, const std::string& section, const char* key){
+		static const std::string empty;
+		auto value = table.Find(section, key);
+		return value ? *value : empty;
 	}
 
 	// iniファイル読み込み：文字列
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, std::string& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, std::string& val){
+		const auto& s = iniGetString(table, section, key);
 		if (!s.empty()) val = s;
 	}
 	// iniファイル読み込み：整数
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, int& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, int& val){
+		const auto& s = iniGetString(table, section, key);
 		if (!s.empty()) val = std::stoi(s);
 	}
 	// iniファイル読み込み：小数
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, float& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, float& val){
+		const auto& s = iniGetString(table, section, key);
 		if (!s.empty()) val = std::stof(s);
 	}
 	// iniファイル読み込み：int64_t（seed用）
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, int64_t& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, int64_t& val){
+		const auto& s = iniGetString(table, section, key);
 		if (!s.empty()) val = std::stoll(s);
 	}
 	// iniファイル読み込み：bool
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, bool& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, bool& val){
+		const auto& s = iniGetString(table, section, key);
 		if (s == "true") val = true; else if (s == "false") val = false;
 	}
 	// iniファイル読み込み：Mode
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, Mode& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, Mode& val){
+		const auto& s = iniGetString(table, section, key);
 		if (s.empty()) return;
 		else if (s == "TXT2IMG") val = TXT2IMG;
 		else if (s == "IMG2IMG") val = IMG2IMG;
 		else if (s == "CONTROL") val = CONTROL;
 	}
+	// iniファイル読み込み：LogLevel
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, LogLevel& val){
+		const auto& s = iniGetString(table, section, key);
+		if (s.empty()) return;
+		else if (s == "error") val = LOG_ERROR;
+		else if (s == "warn") val = LOG_WARN;
+		else if (s == "info") val = LOG_INFO;
+		else if (s == "debug") val = LOG_DEBUG;
+	}
+	// iniファイル読み込み：ResizeFilter
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, ResizeFilter& val){
+		const auto& s = iniGetString(table, section, key);
+		if (s.empty()) return;
+		else if (s == "lanczos") val = LANCZOS;
+		else if (s == "bicubic") val = BICUBIC;
+	}
 	// iniファイル読み込み：sample_method_t
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, sample_method_t& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, sample_method_t& val){
+		const auto& s = iniGetString(table, section, key);
 		if (s.empty()) return;
 		else if (s == "euler_a") val = EULER_A;
 		else if (s == "euler") val = EULER;
@@ -139,8 +490,8 @@ namespace StableDiffusion {
 		else if (s == "lcm") val = LCM;
 	}
 	// iniファイル読み込み：schedule_t
-	static void ini(const std::string& filePath, const std::string& section, const std::string& key, schedule_t& val){
-		auto s = iniGetString(filePath, section, key);
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, schedule_t& val){
+		const auto& s = iniGetString(table, section, key);
 		if (s.empty()) return;
 		else if (s == "default") val = DEFAULT;
 		else if (s == "discrete") val = DISCRETE;
@@ -150,132 +501,313 @@ namespace StableDiffusion {
 		else if (s == "gits") val = GITS;
 	}
 
+	// iniファイル読み込み：sd_type_t
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, sd_type_t& val){
+		const auto& s = iniGetString(table, section, key);
+		if (s.empty()) return;
+		else if (s == "default") val = SD_TYPE_COUNT; // モデルファイルのまま
+		else if (s == "f32") val = SD_TYPE_F32;
+		else if (s == "f16") val = SD_TYPE_F16;
+		else if (s == "q4_0") val = SD_TYPE_Q4_0;
+		else if (s == "q4_1") val = SD_TYPE_Q4_1;
+		else if (s == "q5_0") val = SD_TYPE_Q5_0;
+		else if (s == "q5_1") val = SD_TYPE_Q5_1;
+		else if (s == "q8_0") val = SD_TYPE_Q8_0;
+		else if (s == "q2_k") val = SD_TYPE_Q2_K;
+		else if (s == "q3_k") val = SD_TYPE_Q3_K;
+		else if (s == "q4_k") val = SD_TYPE_Q4_K;
+	}
+	// iniファイル読み込み：rng_type_t
+	static void ini(const IniFile::Table& table, const std::string& section, const char* key, rng_type_t& val){
+		const auto& s = iniGetString(table, section, key);
+		if (s.empty()) return;
+		else if (s == "std_default") val = STD_DEFAULT_RNG;
+		else if (s == "cuda") val = CUDA_RNG;
+	}
+
 	/// 設定のロード
 	/// @param file 設定ファイルのパス
 	/// @param section セクション
 	/// @return 設定データ
 	Params LoadParams(const std::string& filePath, const std::string& section, const Params& defaultParams){
+		return LoadParams(*IniFile::Load(filePath), section, defaultParams);
+	}
+	Params LoadParams(const IniFile::Table& table, const std::string& section, const Params& defaultParams){
 		Params p = defaultParams;
-	    ini(filePath, section, "mode", p.mode);
-	    ini(filePath, section, "model_path", p.model_path);
-	    ini(filePath, section, "clip_l_path", p.clip_l_path);
-	    ini(filePath, section, "clip_g_path", p.clip_g_path);
-	    ini(filePath, section, "t5xxl_path", p.t5xxl_path);
-	    ini(filePath, section, "diffusion_model_path", p.diffusion_model_path);
-	    ini(filePath, section, "vae_path", p.vae_path);
-	    ini(filePath, section, "taesd_path", p.taesd_path);
-	    ini(filePath, section, "controlnet_path", p.controlnet_path);
-	    ini(filePath, section, "lora_model_dir", p.lora_model_dir);
-	    ini(filePath, section, "embeddings_path", p.embeddings_path);
-	    ini(filePath, section, "stacked_id_embeddings_path", p.stacked_id_embeddings_path);
-	    ini(filePath, section, "vae_decode_only", p.vae_decode_only);
-	    ini(filePath, section, "vae_tiling", p.vae_tiling);
-	    ini(filePath, section, "free_params_immediately", p.free_params_immediately);
-	    ini(filePath, section, "n_threads", p.n_threads);
-	    // wtype
-		// rng_type
-	    ini(filePath, section, "schedule", p.schedule);
-	    ini(filePath, section, "clip_on_cpu", p.clip_on_cpu);
-	    ini(filePath, section, "control_net_cpu", p.control_net_cpu);
-	    ini(filePath, section, "vae_on_cpu", p.vae_on_cpu);
-
-	    ini(filePath, section, "prompt", p.prompt);
-	    ini(filePath, section, "negative_prompt", p.negative_prompt);
-	    ini(filePath, section, "clip_skip", p.clip_skip);
-	    ini(filePath, section, "cfg_scale", p.cfg_scale);
-	    ini(filePath, section, "guidance", p.guidance);
-	    ini(filePath, section, "sample_method", p.sample_method);
-	    ini(filePath, section, "sample_steps", p.sample_steps);
-	    ini(filePath, section, "strength", p.strength);
-	    ini(filePath, section, "seed", p.seed);
-	    ini(filePath, section, "control_strength", p.control_strength);
-	    ini(filePath, section, "style_ratio", p.style_ratio);
-	    ini(filePath, section, "normalize_input", p.normalize_input);
-	    ini(filePath, section, "input_id_images_path", p.input_id_images_path);
+		ParamsTable::ForEach([&](const auto& field) { ini(table, section, field.name, p.*field.member); });
 		return p;
 	}
 
+	/// 画像の切り出し（範囲外は黒）
+	static Image CropImage(const Image& image, int x, int y, int width, int height) {
+		Image crop(width, height, 3);
+		memset(crop.data(), 0, crop.size());
+		if (!image.data()) return crop;
+		const int cols = std::min(width, static_cast<int>(image.width) - x);
+		const int rows = std::min(height, static_cast<int>(image.height) - y);
+		for (int row = 0; row < rows; ++row) {
+			auto src = image.data() + ((static_cast<size_t>(y) + row) * image.width + x) * image.channel;
+			auto dst = crop.data() + static_cast<size_t>(row) * width * 3;
+			for (int col = 0; col < cols; ++col, src += image.channel, dst += 3) {
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+			}
+		}
+		return crop;
+	}
+
+	/// 画像の拡張（右と下を端のピクセルで埋める）
+	/// @note 64の倍数に切り上げた生成サイズに合わせる時用、元の範囲は1:1のまま
+	static Image PadImage(const Image& image, int width, int height) {
+		Image pad(width, height, static_cast<int>(image.channel));
+		const int cols = std::min(width, static_cast<int>(image.width));
+		const int rows = std::min(height, static_cast<int>(image.height));
+		const size_t pixelBytes = image.channel;
+		for (int row = 0; row < height; ++row) {
+			auto src = image.data() + static_cast<size_t>(std::min(row, rows - 1)) * image.width * pixelBytes;
+			auto dst = pad.data() + static_cast<size_t>(row) * width * pixelBytes;
+			memcpy(dst, src, cols * pixelBytes);
+			for (int col = cols; col < width; ++col) memcpy(dst + col * pixelBytes, src + (cols - 1) * pixelBytes, pixelBytes);
+		}
+		return pad;
+	}
+
+	/// タイルの書き込み（生成済みの左と上の重なりはフェザーで混ぜる）
+	/// @param canvas 書き込み先
+	/// @param tile タイル画像
+	/// @param x,y 書き込み位置
+	/// @param featherLeft,featherTop 左/上のフェザー幅（0なら混ぜずに上書き）
+	static void BlendTile(const Image& canvas, const Image& tile, int x, int y, int featherLeft, int featherTop) {
+		const int cols = std::min(static_cast<int>(tile.width), static_cast<int>(canvas.width) - x);
+		const int rows = std::min(static_cast<int>(tile.height), static_cast<int>(canvas.height) - y);
+		for (int row = 0; row < rows; ++row) {
+			const int wy = featherTop > 0 ? std::min(256, (row * 256 + 128) / featherTop) : 256;
+			auto src = tile.data() + static_cast<size_t>(row) * tile.width * tile.channel;
+			auto dst = canvas.data() + ((static_cast<size_t>(y) + row) * canvas.width + x) * canvas.channel;
+			for (int col = 0; col < cols; ++col, src += tile.channel, dst += canvas.channel) {
+				const int wx = featherLeft > 0 ? std::min(256, (col * 256 + 128) / featherLeft) : 256;
+				const int w = (wx * wy) >> 8;
+				for (int c = 0; c < 3; ++c) {
+					dst[c] = static_cast<uint8_t>(dst[c] + (((src[c] - dst[c]) * w) >> 8));
+				}
+			}
+		}
+	}
+
+	/// タイル分割で生成するか
+	/// @return タイルサイズが有効で選択範囲の方が大きければtrue
+	static bool IsTiled(const Params& params) {
+		return params.tile_size > 0 && (params.width > params.tile_size || params.height > params.tile_size);
+	}
+
+	/// タイルの開始位置（最後のタイルは端に揃える）
+	static std::vector<int> TilePositions(int length, int tile, int overlap) {
+		std::vector<int> positions{ 0 };
+		const int step = std::max(tile - overlap, 64);
+		while (positions.back() + tile < length) {
+			positions.push_back(std::min(positions.back() + step, length - tile));
+		}
+		return positions;
+	}
+
+	/// タイル分割での画像生成
+	/// @note モデルのネイティブサイズ毎に生成して継ぎ目をぼかして繋ぐ（メモリ使用量がタイルサイズで済む）
+	/// @note t2iはまず全体を1タイル分の面積で描いて引き伸ばし、それを下地に各タイルをi2iで描く（コントロールは元画像をそのまま使う）
+	static std::vector<Image> GenerateTiled(const Params& params, const Image& input, std::function<bool(int,int)> progressCallback, std::vector<float>* stepSeconds) {
+		const int tile = std::max(params.tile_size & ~63, 64);
+		const int overlap = std::clamp(params.tile_overlap, 0, tile / 2);
+		const int tileWidth = std::min(tile, params.width);
+		const int tileHeight = std::min(tile, params.height);
+		const auto xs = TilePositions(params.width, tileWidth, overlap);
+		const auto ys = TilePositions(params.height, tileHeight, overlap);
+		const bool base = params.mode == TXT2IMG;
+		const int passes = static_cast<int>(xs.size() * ys.size()) + (base ? 1 : 0);
+		print("tiled: %d * %d tiles (%d * %d)", static_cast<int>(xs.size()), static_cast<int>(ys.size()), tileWidth, tileHeight);
+
+		// 途中でi2iが入るならコンテキストを作り直さないように最初からエンコード有りで
+		auto commonParams = params;
+		commonParams.tile_size = 0;
+		commonParams.batch_count = 1;
+		if (params.mode != CONTROL) commonParams.vae_decode_only = false;
+
+		// 1回分の生成（中断されていれば始めない）
+		int index = 0;
+		auto generate = [&](const Params& passParams, const Image& passInput) -> std::vector<Image> {
+			if (!progressCallback(index * passParams.sample_steps, passes * passParams.sample_steps)) return {};
+			return Generate(passParams, passInput, [&](int step, int steps) {
+				return progressCallback(index * steps + step, passes * steps);
+			}, stepSeconds);
+		};
+
+		// 下地（t2iは全体の構図を1タイル分の面積で描いて引き伸ばす、i2iは元画像）
+		std::vector<Image> baseResult;
+		if (base) {
+			auto baseParams = commonParams;
+			if (baseParams.native_resolution <= 0) baseParams.native_resolution = tile;
+			baseResult = generate(baseParams, Image());
+			if (baseResult.empty()) return {};
+			++index;
+		}
+		const Image canvas = base ? baseResult.front() : CropImage(input, 0, 0, params.width, params.height);
+
+		for (size_t iy = 0; iy < ys.size(); ++iy) {
+			for (size_t ix = 0; ix < xs.size(); ++ix, ++index) {
+				const int x = xs[ix], y = ys[iy];
+				auto tileParams = commonParams;
+				tileParams.native_resolution = 0;
+				tileParams.width = tileWidth;
+				tileParams.height = tileHeight;
+				if (base) {
+					tileParams.mode = IMG2IMG;
+					tileParams.strength = params.tile_strength;
+				}
+				const auto tileInput =
+					tileParams.mode == CONTROL ? CropImage(input, x, y, tileWidth, tileHeight) :
+					tileParams.mode == IMG2IMG ? CropImage(canvas, x, y, tileWidth, tileHeight) : Image();
+
+				auto result = generate(tileParams, tileInput);
+				if (result.empty()) return {};
+
+				const int featherLeft = ix > 0 ? xs[ix - 1] + tileWidth - x : 0;
+				const int featherTop = iy > 0 ? ys[iy - 1] + tileHeight - y : 0;
+				BlendTile(canvas, result[0], x, y, featherLeft, featherTop);
+			}
+		}
+		return { canvas };
+	}
+
+	// プレビュー用の生成パラメータ
+	// @note モデル関係（MODEL）は変えない、本番と同じコンテキストで描くのでmax_resident_models = 1でもロードし直さない
+	// @note preview_taesd_pathがあればTAESDだけ差し替えた別コンテキストで描く（本番と両方置けるmax_resident_models >= 2の時だけ）
+	Params PreviewParams(const Params& params) {
+		Params p = params;
+		p.preview = false;
+		p.native_resolution = p.native_resolution > 0 ? std::min(p.native_resolution, p.preview_resolution) : p.preview_resolution;
+		p.sample_steps = std::min(p.sample_steps, p.preview_steps);
+		p.sample_method = p.preview_sample_method;
+		p.cfg_scale = p.preview_cfg_scale;
+		p.batch_count = 1;
+		p.tile_size = 0;
+		// 本番がタイル分割ならそのコンテキスト（エンコード有り）に合わせる
+		if (IsTiled(params) && params.mode != CONTROL) p.vae_decode_only = false;
+		if (!p.preview_taesd_path.empty()) {
+			if (p.max_resident_models >= 2) {
+				p.taesd_path = p.preview_taesd_path;
+			} else {
+				static std::atomic<bool> warned;
+				if (!warned.exchange(true)) print(LOG_WARN, "preview_taesd_path is ignored (needs max_resident_models >= 2)");
+			}
+		}
+		return p;
+	}
+
+	/// 生成サイズ
+	/// @return native_resolutionが有効ならその面積で縦横比が近いバケット、無効なら64の倍数に切り上げたサイズ
+	static std::pair<int, int> GenerationSize(const Params& params) {
+		if (params.native_resolution > 0 && params.width > 0 && params.height > 0) {
+			const double area = static_cast<double>(params.native_resolution) * params.native_resolution;
+			const double aspect = static_cast<double>(params.width) / params.height;
+			const int width = std::max(static_cast<int>(std::lround(std::sqrt(area * aspect) / 64)), 1) * 64;
+			const int height = std::max(static_cast<int>(std::lround(std::sqrt(area / aspect) / 64)), 1) * 64;
+			return { width, height };
+		}
+		return { (params.width + 63) & ~63, (params.height + 63) & ~63 };
+	}
+
 	/// 画像生成
 	/// @param params 生成パラメータ
 	/// @param input 入力画像（t2iのコントロールかi2iのベースに使われる）
-	/// @param progressCallback 進捗コールバック void(int step, int steps)
-	/// @return 生成された画像データ
-	Image Generate(const Params& params, const Image& input, std::function<void(int,int)> progressCallback) {
-		sd_set_log_callback(log_callback, (void*)&params);
-		const int batch_count = 1;
+	/// @param progressCallback 進捗コールバック bool(int step, int steps)、falseを返すと中断
+	/// @return 生成された画像データ（batch_count枚）
+	std::vector<Image> Generate(const Params& params, const Image& input, std::function<bool(int,int)> progressCallback, std::vector<float>* stepSeconds) {
+		if (!IsInitialized()) {
+			print(LOG_ERROR, "sd::generate: backend not loaded!");
+			return {};
+		}
+
+		// タイルサイズより大きければ分割して生成
+		if (IsTiled(params)) {
+			return GenerateTiled(params, input, progressCallback, stepSeconds);
+		}
+		verboseLog = params.verbose;
+		const int batch_count = std::max(params.batch_count, 1);
 
-		sd_set_progress_callback([](int step, int steps, float time, void* data){
-			auto callback = reinterpret_cast<decltype(progressCallback)*>(data);
-			(*callback)(step, steps);
-		}, &progressCallback);
+		// 進捗（ステップ時間は呼び出し側に、トレースが有効ならステップ毎の区間も残す）
+		// @note timeはそのステップにかかった秒数、終わった時刻から引いて開始時刻にする
+		// @note バックエンドのコールバックは1つだけのグローバル設定で、ここではスタック上のprogressを渡している。
+		//       生成は1本のワーカースレッド（GenerateAsync）で1つずつ処理する前提なので上書きされない、
+		//       抜ける時に外してダングリングポインタを残さない（Generateを並行して呼ばないこと）
+		struct Progress {
+			decltype(progressCallback)* callback;
+			std::vector<float>* stepSeconds;    // ステップ時間の追加先（無ければnullptr）
+			bool trace;                         // 生成開始時にトレースが有効だったか
+			Trace::Clock::time_point firstStep; // 最初のステップの開始（それまではテキストや入力のエンコード）
+			Trace::Clock::time_point lastStep;  // 最後のステップの終了（それからはデコード）
+		} progress{ &progressCallback, stepSeconds, Trace::Enabled(), {}, {} };
+		struct ProgressReset {
+			~ProgressReset() { backend.sd_set_progress_callback(nullptr, nullptr); }
+		} progressReset;
+		backend.sd_set_progress_callback([](int step, int steps, float time, void* data){
+			auto progress = reinterpret_cast<Progress*>(data);
+			if (progress->stepSeconds) progress->stepSeconds->push_back(time);
+			Metrics::SampleMemory();
+			if (progress->trace) {
+				const auto end = Trace::Clock::now();
+				const auto start = end - std::chrono::duration_cast<Trace::Clock::duration>(std::chrono::duration<float>(time));
+				if (progress->firstStep == Trace::Clock::time_point{}) progress->firstStep = start;
+				progress->lastStep = end;
+				Trace::Complete("step", start, end, "step", step);
+			}
+			if (!(*progress->callback)(step, steps) && backend.cancel) backend.cancel(); // 中断できるバックエンドだけ
+		}, &progress);
 
 		// パラメータの調整
 		auto mode = params.mode;
-		auto width = params.width;
-		auto height = params.height;
-		auto n_threads = params.n_threads;
 		auto seed = params.seed;
 
 		// 入力無しならt2iに
 		if (input.channel == 0) mode = TXT2IMG;
 
-		// スレッド数
-		if (n_threads <= 0) {
-			n_threads = get_num_physical_cores();
-		}
-
 		// ランダムシード
 		if (seed < 0) {
 			srand((int)time(NULL));
 			seed = rand();
 		}
 
-		// 64の倍数サイズに切り上げ
-		width = (width + 0b000000111111) & 0b111111000000;
-		height = (height + 0b000000111111) & 0b111111000000;
+		// 生成サイズ
+		const auto [width, height] = GenerationSize(params);
+
+		// 入力画像も生成サイズに合わせる
+		// @note native_resolutionが無効なら64の倍数への切り上げ分を端で埋めるだけ（選択範囲とは1:1のまま）
+		const bool native = params.native_resolution > 0;
+		const bool resizeInput = UsesInput(params) && input.data() && (static_cast<int>(input.width) != width || static_cast<int>(input.height) != height);
+		const auto source = [&] {
+			TRACE_SCOPE("resize input");
+			return !resizeInput ? input : native ? Resize(input, width, height, params.resize_filter) : PadImage(input, width, height);
+		}();
 
 		// コントロール画像
-		auto control = sd_image_t{ input.width, input.height, input.channel, input.data() };
+		auto control = sd_image_t{ source.width, source.height, source.channel, source.data() };
 		sd_image_t* control_image = nullptr;
-		if (mode == CONTROL && input.channel && params.controlnet_path.size()) {
+		if (mode == CONTROL && source.channel && params.controlnet_path.size()) {
 			control_image = &control;
 		}
 
-		// コンテキスト生成
-		auto sd_ctx = new_sd_ctx(
-			params.model_path.c_str(),
-			params.clip_l_path.c_str(),
-			params.clip_g_path.c_str(),
-			params.t5xxl_path.c_str(),
-			params.diffusion_model_path.c_str(),
-			params.vae_path.c_str(),
-			params.taesd_path.c_str(),
-			params.controlnet_path.c_str(),
-			params.lora_model_dir.c_str(),
-			params.embeddings_path.c_str(),
-			params.stacked_id_embeddings_path.c_str(),
-			params.vae_decode_only,
-			params.vae_tiling,
-			params.free_params_immediately,
-			n_threads,
-			params.wtype,
-			params.rng_type,
-			params.schedule,
-			params.clip_on_cpu,
-			params.control_net_cpu,
-			params.vae_on_cpu);
-
+		// コンテキスト取得（同じモデルならキャッシュか事前ロードの結果を使う）
+		auto sd_ctx = AcquireContext(ContextParams(params));
 		if (!sd_ctx) {
-			print("sd::new_sd_ctx: initialize error!");
-			return Image();
+			print(LOG_ERROR, "sd::new_sd_ctx: initialize error!");
+			return {};
 		}
 
 		// 生成
+		const auto sampleStart = Trace::Clock::now();
 		sd_image_t* results = nullptr;
 		switch (params.mode) {
 		case TXT2IMG:
 		case CONTROL:
-			results = txt2img(sd_ctx,
+			results = backend.txt2img(sd_ctx.get(),
 				params.prompt.c_str(),
 				params.negative_prompt.c_str(),
 				params.clip_skip,
@@ -294,8 +826,8 @@ namespace StableDiffusion {
 				params.input_id_images_path.c_str());
 			break;
 		case IMG2IMG:
-			results = img2img(sd_ctx,
-				sd_image_t{ input.width, input.height, input.channel, input.data() },
+			results = backend.img2img(sd_ctx.get(),
+				sd_image_t{ source.width, source.height, source.channel, source.data() },
 				params.prompt.c_str(),
 				params.negative_prompt.c_str(),
 				params.clip_skip,
@@ -315,15 +847,38 @@ namespace StableDiffusion {
 				params.input_id_images_path.c_str());
 			break;
 		}
-		free_sd_ctx(sd_ctx);
+
+		// デコードまで済んだところのメモリも測る
+		Metrics::SampleMemory();
+
+		// ステップの前後（エンコードとデコード）
+		if (progress.trace && progress.firstStep != Trace::Clock::time_point{}) {
+			const auto sampleEnd = Trace::Clock::now();
+			Trace::Complete("encode", sampleStart, progress.firstStep);
+			Trace::Complete("decode", progress.lastStep, sampleEnd, "batch", batch_count);
+		}
 
 		if (!results) {
-			print("sd::generate error!");
-			return Image();
+			print(LOG_ERROR, "sd::generate error!");
+			return {};
 		}
 
-		auto result = Image(results[0]);
+		// 画像データの所有権はImage側へ（配列だけ解放）
+		// @note 生成サイズが違えば要求されたサイズにリサイズ（native_resolutionが無効なら左上から切り出し）
+		TRACE_SCOPE("resize output");
+		std::vector<Image> images;
+		for (int i = 0; i < batch_count; ++i) {
+			if (!results[i].data) continue;
+			Image image(results[i]);
+			if (static_cast<int>(image.width) == params.width && static_cast<int>(image.height) == params.height) {
+				images.push_back(image);
+			} else if (native) {
+				images.push_back(Resize(image, params.width, params.height, params.resize_filter));
+			} else {
+				images.push_back(CropImage(image, 0, 0, params.width, params.height));
+			}
+		}
 		free(results);
-		return result;
+		return images;
 	}
 }
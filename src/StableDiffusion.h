@@ -5,8 +5,10 @@
  */
 #pragma once
 
-#define SD_BUILD_SHARED_LIB
-#include "stable-diffusion.cpp/stable-diffusion.h"
+#include "SDPlugin.h"
+#include "Backend.h"
+
+namespace IniFile { class Table; }
 
 namespace StableDiffusion {
 	// 生成モード
@@ -16,11 +18,39 @@ namespace StableDiffusion {
 		CONTROL,
 	};
 
+	// リサイズのフィルタ
+	enum ResizeFilter {
+		LANCZOS,
+		BICUBIC,
+	};
+
 	// 生成パラメータ
 	struct Params {
 		// 動作オプション
 		Mode mode{ TXT2IMG };
 		bool verbose{ false };
+		LogLevel log_level{ LOG_INFO };
+		int log_max_kb{ 1024 };
+		bool trace{ false };
+		bool show_metrics{ false };
+		std::string backend{};
+		int stub_step_ms{ 100 };
+		int stub_load_ms{ 0 };
+		bool preload{ true };
+		int max_resident_models{ 1 };
+		int model_memory_mb{ 0 };
+		int result_cache_mb{ 512 };
+		int result_cache_disk_mb{ 0 };
+		bool speculative{ false };
+		int speculative_delay_ms{ 1000 };
+
+		// プレビュー設定
+		bool preview{ false };
+		int preview_resolution{ 384 };
+		int preview_steps{ 4 };
+		sample_method_t preview_sample_method{ LCM };
+		float preview_cfg_scale{ 1.0f };
+		std::string preview_taesd_path{};
 
 		// 基本設定
 		std::string model_path{};
@@ -55,12 +85,24 @@ namespace StableDiffusion {
 		int height{ 1024 };
 		sample_method_t sample_method{ EULER_A };
 		int sample_steps{ 20 };
+		int batch_count{ 1 };
+		int tile_size{ 0 };
+		int tile_overlap{ 128 };
+		float tile_strength{ 0.8f };
+		int native_resolution{ 0 };
+		ResizeFilter resize_filter{ LANCZOS };
+		bool fill_transparent{ false };
+		bool mask_crop{ false };
+		bool mask_islands{ false };
+		int mask_padding{ 64 };
 		float strength{ 0.75f };
 		int64_t seed{ -1 };
 		float control_strength{ 0.9f };
 		float style_ratio{ 20.f };
 		bool normalize_input{ false };
 		std::string input_id_images_path{};
+
+		bool operator==(const Params&) const = default;
 	};
 
 	// イメージ
@@ -71,28 +113,117 @@ namespace StableDiffusion {
 		const uint32_t height;
 		const uint32_t channel;
 		uint8_t* data() const { return static_cast<uint8_t*>(data_.get()); }
+		size_t size() const { return static_cast<size_t>(width) * height * channel; }
+		bool unique() const { return data_.use_count() == 1; }
 		Image() noexcept : width{ 0 }, height{ 0 }, channel{ 0 } {}
 		Image(uint32_t w, uint32_t h, uint32_t c) : width{ w }, height{ h }, channel{ c }, data_{ malloc(w * h * c), free } {}
 		Image(int w, int h, int c) : Image{ static_cast<uint32_t>(w), static_cast<uint32_t>(h), static_cast<uint32_t>(c) } {}
 		Image(sd_image_t const& image) : width{ image.width }, height{ image.height }, channel{ image.channel }, data_{ image.data, free } {}
+		Image(uint32_t w, uint32_t h, uint32_t c, std::shared_ptr<void> data) : width{ w }, height{ h }, channel{ c }, data_{ std::move(data) } {}
 	};
 
-	/// ライブラリ初期化
-	extern void Initialize(const std::string& base_path);
+	/// 非同期の生成ジョブ
+	/// @note 進捗と結果はワーカースレッドが書き込む（ホスト側はWaitで完了を待ちつつ進捗を読む）
+	class Job {
+		std::mutex mutex_;
+		std::condition_variable condition_;
+		bool done_{ false };
+		std::vector<Image> results_;
+		std::vector<float> stepSeconds_;
+	public:
+		const Params params;
+		const Image input;
+		std::atomic<int> step{ 0 };
+		std::atomic<int> steps{ 0 };
+		std::atomic<bool> cancelled{ false };
+		Job(const Params& params, const Image& input) : params{ params }, input{ input }, steps{ params.sample_steps } {}
+
+		/// 中断要求（対応してるバックエンドなら次のステップで打ち切る）
+		void Cancel() { cancelled = true; }
+
+		/// 完了待ち
+		/// @return 完了していればtrue
+		bool Wait(std::chrono::milliseconds timeout) {
+			std::unique_lock lock(mutex_);
+			return condition_.wait_for(lock, timeout, [this] { return done_; });
+		}
+
+		/// 完了通知（ワーカー側から呼ぶ）
+		/// @param stepSeconds 各ステップにかかった秒数
+		void Finish(std::vector<Image> results, std::vector<float> stepSeconds = {}) {
+			{
+				std::lock_guard lock(mutex_);
+				results_ = std::move(results);
+				stepSeconds_ = std::move(stepSeconds);
+				done_ = true;
+			}
+			condition_.notify_all();
+		}
+
+		/// 生成結果（完了後のみ有効）
+		const std::vector<Image>& Results() const { return results_; }
+
+		/// 各ステップにかかった秒数（完了後のみ有効）
+		/// @note 統計は結果を使う側で取る（投機的生成や中断されたジョブの分は数えない）
+		const std::vector<float>& StepSeconds() const { return stepSeconds_; }
+	};
 
 	/// ライブラリ初期化
+	/// @param base_path DLLを探しに行くベースパス
+	/// @param params 生成パラメータ（バックエンドの選択に使う）
+	extern void Initialize(const std::string& base_path, const Params& params);
+
+	/// ライブラリ解放
 	extern void Terminate();
 
+	/// 生成を途中で中断できるか
+	/// @return ロード済みのバックエンドが中断に対応していればtrue（stable-diffusion.cppのDLLは非対応なので最後のステップまで走る）
+	extern bool CanCancel();
+
+	/// 事前ロード
+	/// @param base_path DLLを探しに行くベースパス
+	/// @param params 生成パラメータ（モデル関係だけ使う）
+	/// @note バックグラウンドでDLLとモデルを読み込んでおく（生成時はその結果を待って使う）
+	extern void Preload(const std::string& base_path, const Params& params);
+
 	/// 設定のロード
 	/// @param filePath 設定ファイルのパス
 	/// @param section セクション
 	/// @return 設定データ
 	extern Params LoadParams(const std::string& filePath, const std::string& section, const Params& defaultParams = Params());
 
+	/// 設定のロード（読み込み済みの内容から）
+	/// @param table 設定ファイルの内容
+	/// @param section セクション
+	/// @return 設定データ
+	extern Params LoadParams(const IniFile::Table& table, const std::string& section, const Params& defaultParams = Params());
+
+	/// 使われなくなったモデルの解放（設定ファイルが変わった時用）
+	/// @param params 今の設定一覧（どれかとモデルが一致する常駐コンテキストは残す）
+	extern void RetainModels(const std::vector<Params>& params);
+
+	/// 入力画像を使うか
+	/// @note i2iかコントロール（ControlNet有り）の時だけ、t2iなら入力画像は取り込まなくて良い
+	inline bool UsesInput(const Params& params) {
+		return params.mode == IMG2IMG || (params.mode == CONTROL && !params.controlnet_path.empty());
+	}
+
+	/// プレビュー用の生成パラメータ
+	/// @param params 元の生成パラメータ
+	/// @return 縮小解像度＆少ないステップ数（preview_*の設定）に差し替えた生成パラメータ
+	extern Params PreviewParams(const Params& params);
+
 	/// 画像生成
 	/// @param params 生成パラメータ
 	/// @param input 入力画像（t2iのコントロールかi2iのベースに使われる）
-	/// @param progressCallback 進捗コールバック void(int step, int steps)
-	/// @return 生成された画像データ
-	extern Image Generate(const Params& params, const Image& input, std::function<void(int,int)> progressCallback);
+	/// @param progressCallback 進捗コールバック bool(int step, int steps)、falseを返すと中断
+	/// @param stepSeconds 各ステップにかかった秒数の追加先（要らなければnullptr）
+	/// @return 生成された画像データ（batch_count枚）
+	extern std::vector<Image> Generate(const Params& params, const Image& input, std::function<bool(int,int)> progressCallback, std::vector<float>* stepSeconds = nullptr);
+
+	/// 非同期の画像生成
+	/// @param params 生成パラメータ
+	/// @param input 入力画像
+	/// @return 生成ジョブ（ワーカースレッドで順番に処理される）
+	extern std::shared_ptr<Job> GenerateAsync(const Params& params, const Image& input);
 }
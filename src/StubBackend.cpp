@@ -0,0 +1,168 @@
+/**
+ * @file StubBackend.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 生成バックエンド：スタブ版
+ * @note モデル無しで決まった模様を返す（転送周りの計測やGPU無しの環境用）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Backend.h"
+
+namespace StableDiffusion::Stub {
+	/// @brief 1ステップ毎の待ち時間（ミリ秒）
+	static int stepMilliseconds;
+
+	/// @brief コンテキスト作成の待ち時間（ミリ秒）
+	static int loadMilliseconds;
+
+	// コールバック
+	static sd_log_cb_t logCallback;
+	static void* logData;
+	static sd_progress_cb_t progressCallback;
+	static void* progressData;
+
+	/// @brief スタブのコンテキスト
+	struct Context {
+		int n_threads;
+	};
+
+	static void Log(sd_log_level_t level, const char* text) {
+		if (logCallback) logCallback(level, text, logData);
+	}
+
+	/// 中断要求
+	static std::atomic<bool> cancelRequested;
+
+	/// サンプリングの代わりに待つだけ
+	/// @return 中断されたらfalse
+	static bool Sample(int sample_steps) {
+		cancelRequested = false;
+		for (int step = 1; step <= sample_steps; ++step) {
+			const auto start = std::chrono::steady_clock::now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(stepMilliseconds));
+			const std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+			if (progressCallback) progressCallback(step, sample_steps, elapsed.count(), progressData);
+			if (cancelRequested) {
+				Log(SD_LOG_INFO, "stub: cancelled");
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// 模様の生成（シード毎に色が変わる格子とグラデーション）
+	/// @param init ベース画像（無ければnullptr、あればstrengthの割合で模様と混ぜる）
+	static sd_image_t* Generate(int width, int height, int64_t seed, int batch_count, const sd_image_t* init, float strength) {
+		if (width <= 0 || height <= 0 || batch_count <= 0) return nullptr;
+		auto results = static_cast<sd_image_t*>(calloc(batch_count, sizeof(sd_image_t)));
+		if (!results) return nullptr;
+
+		const auto blend = static_cast<int>(std::clamp(strength, 0.0f, 1.0f) * 256);
+		for (int i = 0; i < batch_count; ++i) {
+			const auto hash = static_cast<uint32_t>((seed + i) * 2654435761u);
+			const uint8_t tint[3] = { uint8_t(hash), uint8_t(hash >> 8), uint8_t(hash >> 16) };
+
+			auto& image = results[i];
+			image = sd_image_t{ uint32_t(width), uint32_t(height), 3, static_cast<uint8_t*>(malloc(size_t(width) * height * 3)) };
+			if (!image.data) continue;
+			for (int y = 0; y < height; ++y) {
+				auto p = image.data + size_t(y) * width * 3;
+				for (int x = 0; x < width; ++x, p += 3) {
+					const bool cell = ((x >> 6) ^ (y >> 6)) & 1;
+					const int gradient = (x * 255 / width + y * 255 / height) / 2;
+					for (int c = 0; c < 3; ++c) {
+						int value = cell ? tint[c] : gradient;
+						if (init && init->data && x < int(init->width) && y < int(init->height)) {
+							const int base = init->data[(size_t(y) * init->width + x) * init->channel + c];
+							value = base + (((value - base) * blend) >> 8);
+						}
+						p[c] = static_cast<uint8_t>(value);
+					}
+				}
+			}
+		}
+		return results;
+	}
+
+	static sd_ctx_t* new_sd_ctx(const char* model_path, const char* clip_l_path, const char* clip_g_path, const char* t5xxl_path,
+		const char* diffusion_model_path, const char* vae_path, const char* taesd_path, const char* control_net_path_c_str,
+		const char* lora_model_dir, const char* embed_dir_c_str, const char* stacked_id_embed_dir_c_str,
+		bool vae_decode_only, bool vae_tiling, bool free_params_immediately, int n_threads,
+		enum sd_type_t wtype, enum rng_type_t rng_type, enum schedule_t s,
+		bool keep_clip_on_cpu, bool keep_control_net_cpu, bool keep_vae_on_cpu) {
+		Log(SD_LOG_INFO, "stub: new_sd_ctx");
+		std::this_thread::sleep_for(std::chrono::milliseconds(loadMilliseconds));
+		return reinterpret_cast<sd_ctx_t*>(new Context{ n_threads });
+	}
+
+	static void free_sd_ctx(sd_ctx_t* sd_ctx) {
+		Log(SD_LOG_INFO, "stub: free_sd_ctx");
+		delete reinterpret_cast<Context*>(sd_ctx);
+	}
+
+	static sd_image_t* txt2img(sd_ctx_t* sd_ctx, const char* prompt, const char* negative_prompt, int clip_skip,
+		float cfg_scale, float guidance, int width, int height, enum sample_method_t sample_method, int sample_steps,
+		int64_t seed, int batch_count, const sd_image_t* control_cond, float control_strength, float style_strength,
+		bool normalize_input, const char* input_id_images_path) {
+		if (!sd_ctx) return nullptr;
+		if (!Sample(sample_steps)) return nullptr;
+		return Generate(width, height, seed, batch_count, control_cond, 0.5f);
+	}
+
+	static sd_image_t* img2img(sd_ctx_t* sd_ctx, sd_image_t init_image, const char* prompt, const char* negative_prompt,
+		int clip_skip, float cfg_scale, float guidance, int width, int height, enum sample_method_t sample_method,
+		int sample_steps, float strength, int64_t seed, int batch_count, const sd_image_t* control_cond,
+		float control_strength, float style_strength, bool normalize_input, const char* input_id_images_path) {
+		if (!sd_ctx) return nullptr;
+		if (!Sample(static_cast<int>(sample_steps * strength))) return nullptr;
+		return Generate(width, height, seed, batch_count, &init_image, strength);
+	}
+
+	static int32_t get_num_physical_cores() {
+		return std::max(1, static_cast<int>(std::thread::hardware_concurrency() / 2));
+	}
+
+	static const char* sd_type_name(enum sd_type_t type) {
+		return "stub";
+	}
+
+	static void sd_set_log_callback(sd_log_cb_t sd_log_cb, void* data) {
+		logCallback = sd_log_cb;
+		logData = data;
+	}
+
+	static void sd_set_progress_callback(sd_progress_cb_t cb, void* data) {
+		progressCallback = cb;
+		progressData = data;
+	}
+
+	static void cancel() {
+		cancelRequested = true;
+	}
+}
+
+namespace StableDiffusion {
+#define BIND_FUNCTION(function) backend.function = Stub::function
+
+	/// スタブのバックエンド
+	/// @param backend 設定先
+	/// @param step_ms 1ステップ毎の待ち時間（ミリ秒）
+	/// @param load_ms コンテキスト作成の待ち時間（ミリ秒）
+	void LoadStubBackend(Backend& backend, int step_ms, int load_ms) {
+		print("LoadStubBackend: %d ms/step, %d ms/load", step_ms, load_ms);
+		Stub::stepMilliseconds = std::max(step_ms, 0);
+		Stub::loadMilliseconds = std::max(load_ms, 0);
+
+		backend = Backend{};
+		BIND_FUNCTION(new_sd_ctx);
+		BIND_FUNCTION(free_sd_ctx);
+		BIND_FUNCTION(img2img);
+		BIND_FUNCTION(txt2img);
+		BIND_FUNCTION(get_num_physical_cores);
+		BIND_FUNCTION(sd_type_name);
+		BIND_FUNCTION(sd_set_log_callback);
+		BIND_FUNCTION(sd_set_progress_callback);
+		BIND_FUNCTION(cancel);
+	}
+}
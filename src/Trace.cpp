@@ -0,0 +1,83 @@
+/**
+ * @file Trace.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 処理時間のトレース
+ */
+#include "pch.h"
+
+#include "Trace.h"
+
+namespace Trace {
+	// 区間（"ph":"X"）
+	struct Event {
+		const char* name;
+		const char* argName;
+		int64_t argValue;
+		Clock::time_point start;
+		Clock::time_point end;
+		uint32_t thread;
+	};
+	constexpr size_t kMaxEvents = 200000; // これ以上は捨てる（長時間動かしっぱなしでも膨らまないように）
+
+	static std::string tracePath;
+	static std::atomic<bool> traceEnabled;
+	static std::mutex eventMutex;
+	static std::vector<Event> events;
+	static Clock::time_point origin = Clock::now(); // 時刻の基準
+	static std::atomic<uint32_t> threadCounter;
+
+	/// スレッド番号（登場順の小さい番号）
+	static uint32_t ThreadId() {
+		thread_local const uint32_t id = ++threadCounter;
+		return id;
+	}
+
+	void Open(const std::string& filePath) {
+		std::lock_guard<std::mutex> lock(eventMutex);
+		tracePath = filePath;
+		events.clear();
+		std::error_code error;
+		std::filesystem::remove(tracePath, error);
+	}
+
+	void Configure(bool enabled) {
+		traceEnabled = enabled;
+	}
+
+	bool Enabled() {
+		return traceEnabled.load(std::memory_order_relaxed);
+	}
+
+	void Complete(const char* name, Clock::time_point start, Clock::time_point end, const char* argName, int64_t argValue) {
+		if (!Enabled()) return;
+		const auto thread = ThreadId();
+		std::lock_guard<std::mutex> lock(eventMutex);
+		if (events.size() >= kMaxEvents) return;
+		events.push_back({ name, argName, argValue, start, end, thread });
+	}
+
+	/// 基準からのマイクロ秒
+	static long long Microseconds(Clock::duration duration) {
+		return static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+	}
+
+	void Flush() {
+		std::lock_guard<std::mutex> lock(eventMutex);
+		if (tracePath.empty() || events.empty()) return;
+
+		std::ofstream file(tracePath, std::ios::binary | std::ios::trunc);
+		if (!file) return;
+		file << "{\"traceEvents\":[\n";
+		char line[256];
+		for (size_t i = 0; i < events.size(); ++i) {
+			const auto& e = events[i];
+			int length = snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld",
+				e.name, e.thread, Microseconds(e.start - origin), Microseconds(e.end - e.start));
+			if (e.argName && length > 0 && length < static_cast<int>(sizeof(line))) {
+				length += snprintf(line + length, sizeof(line) - length, ",\"args\":{\"%s\":%lld}", e.argName, static_cast<long long>(e.argValue));
+			}
+			file << line << (i + 1 < events.size() ? "},\n" : "}\n");
+		}
+		file << "],\"displayTimeUnit\":\"ms\"}\n";
+	}
+}
@@ -0,0 +1,54 @@
+/**
+ * @file Trace.h
+ * @author 青猫 (AonekoSS)
+ * @brief 処理時間のトレース（chrome://tracing / Perfetto で読めるJSON）
+ * @note 無効の時はフラグを見るだけ、有効の時もメモリに溜めて実行の区切りでまとめて書き出す
+ */
+#pragma once
+
+namespace Trace {
+	using Clock = std::chrono::steady_clock;
+
+	/// 書き出し先の設定（前回のトレースは消す）
+	/// @param filePath トレースファイルのパス
+	extern void Open(const std::string& filePath);
+
+	/// 有効／無効の切り替え
+	extern void Configure(bool enabled);
+
+	/// 記録するか
+	extern bool Enabled();
+
+	/// 区間を記録
+	/// @param name 区間の名前（文字列リテラルのみ、ポインタのまま保持する）
+	/// @param start 開始時刻
+	/// @param end 終了時刻
+	/// @param argName 添える値の名前（無ければnullptr、nameと同じく文字列リテラルのみ）
+	/// @param argValue 添える値
+	extern void Complete(const char* name, Clock::time_point start, Clock::time_point end, const char* argName = nullptr, int64_t argValue = 0);
+
+	/// ファイルに書き出し
+	/// @note Open以降に溜まった全区間で書き直す
+	extern void Flush();
+
+	/// スコープの区間を記録
+	class Scope {
+	public:
+		explicit Scope(const char* name) : name(Enabled() ? name : nullptr) {
+			if (this->name) start = Clock::now();
+		}
+		~Scope() {
+			if (name) Complete(name, start, Clock::now());
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		const char* name;
+		Clock::time_point start;
+	};
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+/// このスコープを区間として記録
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
@@ -1,9 +1,40 @@
 #pragma once
+#ifdef _WIN32
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/resource.h>
+#endif
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <array>
+#include <list>
+#include <deque>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
 #include <functional>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
@@ -0,0 +1,127 @@
+/**
+ * @file Bench.h
+ * @author 青猫 (AonekoSS)
+ * @brief ベンチマーク用の計測（時間、サイクル数）
+ * @note サイクル数はLinuxならperfのCPUサイクル、使えなければTSC（x64のみ）、どちらも無ければ出さない
+ */
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define BENCH_TSC
+#endif
+
+namespace Bench {
+	/// サイクルカウンタ
+	class Cycles {
+	public:
+		Cycles() {
+#if defined(__linux__)
+			perf_event_attr attr{};
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.inherit = 1; // ParallelForのスレッドも数える
+			fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+		}
+		~Cycles() {
+#if defined(__linux__)
+			if (fd >= 0) close(fd);
+#endif
+		}
+		Cycles(const Cycles&) = delete;
+		Cycles& operator=(const Cycles&) = delete;
+
+		/// 何で数えているか
+		const char* source() const {
+			if (fd >= 0) return "perf cycles";
+#ifdef BENCH_TSC
+			return "tsc";
+#else
+			return "none";
+#endif
+		}
+
+		void start() {
+#if defined(__linux__)
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+				return;
+			}
+#endif
+#ifdef BENCH_TSC
+			begin = __rdtsc();
+#endif
+		}
+
+		/// startからのサイクル数（数えられなければ0）
+		uint64_t stop() {
+#if defined(__linux__)
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+				uint64_t count = 0;
+				if (read(fd, &count, sizeof(count)) != sizeof(count)) return 0;
+				return count;
+			}
+#endif
+#ifdef BENCH_TSC
+			return __rdtsc() - begin;
+#else
+			return 0;
+#endif
+		}
+	private:
+		int fd{ -1 };
+		uint64_t begin{ 0 };
+	};
+
+	/// 計測結果
+	struct Result {
+		double seconds;  // 1回あたり
+		uint64_t cycles; // 1回あたり
+	};
+
+	/// 計測（1回空回ししてから、合計がminSeconds以上になるまで繰り返す）
+	template <class F>
+	Result Measure(Cycles& cycles, F&& func, double minSeconds = 0.3) {
+		func();
+		int iterations = 0;
+		uint64_t totalCycles = 0;
+		const auto start = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			cycles.start();
+			func();
+			totalCycles += cycles.stop();
+			++iterations;
+			elapsed = std::chrono::steady_clock::now() - start;
+		} while (elapsed.count() < minSeconds);
+		return { elapsed.count() / iterations, totalCycles / iterations };
+	}
+
+	/// ピクセル処理の結果を1行で
+	/// @param bytes 1回で読み書きするバイト数
+	inline void Report(const std::string& name, const Result& result, int64_t pixels, int64_t bytes) {
+		printf("%-40s %9.3f ms %9.1f Mpix/s %9.1f MB/s %8.2f cycles/pix\n", name.c_str(), result.seconds * 1e3,
+			pixels / result.seconds * 1e-6, bytes / result.seconds * 1e-6,
+			pixels ? static_cast<double>(result.cycles) / pixels : 0.0);
+	}
+}
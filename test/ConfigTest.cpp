@@ -0,0 +1,107 @@
+/**
+ * @file ConfigTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイルの監視（Config）のテスト
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Config.h"
+#include "Test.h"
+
+/// 設定ファイルの書き出し
+static void WriteIni(const std::filesystem::path& path, const std::string& steps) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << "[COMMON]\nbackend = stub\n[test]\nsample_steps = " << steps << "\n";
+}
+
+/// 読み直されるまで待つ
+/// @return 時間内にsample_stepsがexpectedになればtrue
+static bool WaitSteps(int expected) {
+	for (int i = 0; i < 100; ++i) {
+		const auto config = Config::Current();
+		const auto found = config->Find("test");
+		if (found && found->sample_steps == expected) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	return false;
+}
+
+/// おかしな値に書き換えられても落ちずに前の設定のまま
+static void TestMalformedEdit() {
+	const auto dir = std::filesystem::temp_directory_path() / "sdplugin_config_test";
+	std::filesystem::create_directories(dir);
+	const auto path = dir / "SDPlugin.ini";
+	WriteIni(path, "12");
+
+	Config::Start(path.string());
+	CHECK(WaitSteps(12));
+
+	// 数字じゃない
+	WriteIni(path, "abc");
+	std::this_thread::sleep_for(std::chrono::milliseconds(400));
+	CHECK(WaitSteps(12));
+
+	// 範囲外
+	WriteIni(path, "99999999999999999999");
+	std::this_thread::sleep_for(std::chrono::milliseconds(400));
+	CHECK(WaitSteps(12));
+
+	// 直せば読み直される
+	WriteIni(path, "30");
+	CHECK(WaitSteps(30));
+
+	Config::Stop();
+	std::error_code error;
+	std::filesystem::remove_all(dir, error);
+}
+
+/// 最初からおかしければ空のまま（例外は外に出さない）
+static void TestMalformedStart() {
+	const auto dir = std::filesystem::temp_directory_path() / "sdplugin_config_test_start";
+	std::filesystem::create_directories(dir);
+	const auto path = dir / "SDPlugin.ini";
+	WriteIni(path, "x1");
+
+	Config::Start(path.string());
+	CHECK(Config::Current()->Find("test") == nullptr);
+	Config::Stop();
+	std::error_code error;
+	std::filesystem::remove_all(dir, error);
+}
+
+/// 差し替えた古い設定は使い終わったら解放される（持っている間は残る）
+static void TestSnapshotLifetime() {
+	const auto dir = std::filesystem::temp_directory_path() / "sdplugin_config_test_lifetime";
+	std::filesystem::create_directories(dir);
+	const auto path = dir / "SDPlugin.ini";
+	WriteIni(path, "1");
+
+	Config::Start(path.string());
+	CHECK(WaitSteps(1));
+	auto held = Config::Current();
+	std::weak_ptr<const Config::Snapshot> released = Config::Current();
+	held.reset();
+
+	// 保持していた方は残る
+	held = Config::Current();
+	WriteIni(path, "22");
+	CHECK(WaitSteps(22));
+	CHECK(held->Find("test") && held->Find("test")->sample_steps == 1);
+
+	// 誰も持っていなければ解放される
+	held.reset();
+	CHECK(released.expired());
+
+	Config::Stop();
+	CHECK(Config::Current()->sections.empty());
+	std::error_code error;
+	std::filesystem::remove_all(dir, error);
+}
+
+int main() {
+	TestMalformedEdit();
+	TestMalformedStart();
+	TestSnapshotLifetime();
+	return Test::Result("ConfigTest");
+}
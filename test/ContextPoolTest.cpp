@@ -0,0 +1,105 @@
+/**
+ * @file ContextPoolTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 常駐コンテキストのプール（AcquireContext、RetainModels）のテスト
+ * @note スタブのロード時間を長めにして、事前ロード中に別のモデルの生成や解放が待たされないか、生成中のモデルを追い出さないかを時間で見る
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "StableDiffusion.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+constexpr int kLoadMilliseconds = 400;
+constexpr int kStepMilliseconds = 20;
+
+static Params StubParams(const char* model, int maxModels) {
+	Params params;
+	params.backend = "stub";
+	params.stub_step_ms = kStepMilliseconds;
+	params.stub_load_ms = kLoadMilliseconds;
+	params.model_path = model;
+	params.prompt = "test";
+	params.sample_steps = 1;
+	params.width = 64;
+	params.height = 64;
+	params.preload = true;
+	params.max_resident_models = maxModels;
+	params.free_params_immediately = false;
+	return params;
+}
+
+/// 1枚生成してかかった時間（ミリ秒）
+static double GenerateMilliseconds(const Params& params) {
+	const auto start = std::chrono::steady_clock::now();
+	const auto images = Generate(params, Image(), [](int, int) { return true; });
+	CHECK(images.size() == 1);
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// 別のモデルの事前ロード中でも、常駐しているモデルの生成はロードを待たない
+static void TestPreloadDoesNotBlock() {
+	const auto a = StubParams("a.safetensors", 2);
+	const auto b = StubParams("b.safetensors", 2);
+	GenerateMilliseconds(a); // aを常駐させる
+	Preload("", b);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50)); // bのロードが始まるまで
+	const auto elapsed = GenerateMilliseconds(a);
+	CHECK(elapsed < kLoadMilliseconds / 2);
+	std::this_thread::sleep_for(std::chrono::milliseconds(kLoadMilliseconds)); // bのロードが終わるまで
+
+	// ロード中のモデルの生成はロードの完了を待ってそれを使う（ロードし直さない）
+	const auto loading = StubParams("c.safetensors", 3);
+	Preload("", loading);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	const auto waited = GenerateMilliseconds(loading);
+	CHECK(waited < kLoadMilliseconds);
+}
+
+/// 事前ロードは生成中のモデルを追い出さない（1つしか置けなければロードしない）
+static void TestPreloadKeepsInUse() {
+	const auto a = StubParams("d.safetensors", 1);
+	const auto b = StubParams("e.safetensors", 1);
+	GenerateMilliseconds(a); // 他を追い出してaだけにする
+
+	auto running = a;
+	running.sample_steps = 20;
+	auto job = GenerateAsync(running, Image());
+	std::this_thread::sleep_for(std::chrono::milliseconds(50)); // aで生成中
+	Preload("", b);
+	CHECK(job->Wait(std::chrono::seconds(10)));
+	CHECK(job->Results().size() == 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(kLoadMilliseconds)); // 事前ロードが走っていたら終わるまで
+
+	// aが常駐したままならロード無しで生成できる
+	const auto elapsed = GenerateMilliseconds(a);
+	CHECK(elapsed < kLoadMilliseconds / 2);
+}
+
+/// 設定変更時の解放はロードを待たない（ロード中のものは外さない）
+static void TestRetainDuringLoad() {
+	const auto a = StubParams("f.safetensors", 2);
+	const auto b = StubParams("g.safetensors", 2);
+	GenerateMilliseconds(a);
+	Preload("", b);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50)); // bのロードが始まるまで
+	const auto start = std::chrono::steady_clock::now();
+	RetainModels({ b });
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	CHECK(elapsed.count() < kLoadMilliseconds / 2);
+
+	// bはロード中でも外されずに、ロードが終わればそのまま使える
+	std::this_thread::sleep_for(std::chrono::milliseconds(kLoadMilliseconds));
+	CHECK(GenerateMilliseconds(b) < kLoadMilliseconds / 2);
+}
+
+int main() {
+	Initialize("", StubParams("a.safetensors", 2));
+	TestPreloadDoesNotBlock();
+	TestPreloadKeepsInUse();
+	TestRetainDuringLoad();
+	Terminate();
+	return Test::Result("ContextPoolTest");
+}
@@ -0,0 +1,75 @@
+/**
+ * @file FillTransparentBench.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 透明部分の穴埋め（ImageProcessのFillTransparent）のベンチマーク
+ * @note 8K（7680x4320）のレイヤー、穴が大きい場合と小さい穴が散らばっている場合
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "ImageProcess.h"
+#include "Bench.h"
+
+using namespace StableDiffusion;
+
+constexpr int kWidth = 7680, kHeight = 4320;
+
+/// 模様の画像（グラデーションに細かい格子）
+static Image Pattern(int width, int height, int channel) {
+	Image image(width, height, channel);
+	auto p = image.data();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x, p += channel) {
+			p[0] = static_cast<uint8_t>(x * 255 / width);
+			p[1] = static_cast<uint8_t>(y * 255 / height);
+			p[2] = ((x ^ y) & 8) ? 255 : 0;
+			if (channel > 3) p[3] = 255;
+		}
+	}
+	return image;
+}
+
+/// 円の穴を開けたアルファ
+/// @param cell 円を並べる間隔
+/// @param radius 円の半径
+static Image Holes(int width, int height, int cell, int radius) {
+	Image alpha(width, height, 1);
+	auto p = alpha.data();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x, ++p) {
+			const int dx = x % cell - cell / 2, dy = y % cell - cell / 2;
+			*p = dx * dx + dy * dy < radius * radius ? 0 : 255;
+		}
+	}
+	return alpha;
+}
+
+/// 1つの穴埋めを計測（ピクセルあたり）
+/// @note 穴埋めは画像を書き換えるので毎回元に戻す（戻す分は別に計測して差し引く）
+static void BenchFill(Bench::Cycles& cycles, const char* name, const Image& alpha, int channel) {
+	const auto source = Pattern(kWidth, kHeight, channel);
+	const Image image(static_cast<int>(source.width), static_cast<int>(source.height), channel);
+	const auto copy = Bench::Measure(cycles, [&] { std::memcpy(image.data(), source.data(), source.size()); });
+	auto fill = Bench::Measure(cycles, [&] {
+		std::memcpy(image.data(), source.data(), source.size());
+		FillTransparent(image, alpha);
+	}, 1.0);
+	fill.seconds -= copy.seconds;
+	fill.cycles -= copy.cycles;
+	const int64_t pixels = static_cast<int64_t>(kWidth) * kHeight;
+	const int64_t bytes = static_cast<int64_t>(image.size()) * 2 + alpha.size();
+	Bench::Report(name, fill, pixels, bytes);
+}
+
+int main() {
+	Bench::Cycles cycles;
+	printf("FillTransparentBench (cycles: %s)\n", cycles.source());
+	const auto large = Holes(kWidth, kHeight, 1024, 400); // 半分くらい透明
+	const auto small = Holes(kWidth, kHeight, 64, 8);     // 小さい穴が散らばる
+	BenchFill(cycles, "rgb 8k large holes", large, 3);
+	BenchFill(cycles, "rgba 8k large holes", large, 4);
+	BenchFill(cycles, "rgb 8k small holes", small, 3);
+	FilterPlugIn::TerminateParallelFor();
+	return 0;
+}
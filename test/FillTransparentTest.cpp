@@ -0,0 +1,202 @@
+/**
+ * @file FillTransparentTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 透明部分の穴埋め（FillTransparent）のテスト
+ * @note 不透明なピクセルはそのまま、穴は埋まる、結果がスカラー版（元の実装）とビット単位で一致するか
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "ImageProcess.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+namespace Reference {
+	/// @brief ピラミッドの段（RGB＋重み）
+	struct Level {
+		int width, height;
+		std::vector<uint8_t> pixels;
+		Level(int w, int h) : width{ w }, height{ h }, pixels(static_cast<size_t>(w) * h * 4) {}
+		uint8_t* at(int x, int y) { return &pixels[(static_cast<size_t>(y) * width + x) * 4]; }
+		const uint8_t* at(int x, int y) const { return &pixels[(static_cast<size_t>(y) * width + x) * 4]; }
+	};
+
+	/// 2x2の重み付き平均で1段縮小
+	static Level Push(const Level& fine, int& holes) {
+		Level coarse{ (fine.width + 1) / 2, (fine.height + 1) / 2 };
+		holes = 0;
+		for (int y = 0; y < coarse.height; ++y) {
+			for (int x = 0; x < coarse.width; ++x) {
+				int sum[4] = {};
+				for (const int sy : { y * 2, std::min(y * 2 + 1, fine.height - 1) }) {
+					for (const int sx : { x * 2, std::min(x * 2 + 1, fine.width - 1) }) {
+						const auto s = fine.at(sx, sy);
+						for (int c = 0; c < 3; ++c) sum[c] += s[c] * s[3];
+						sum[3] += s[3];
+					}
+				}
+				const auto p = coarse.at(x, y);
+				const int w = sum[3];
+				for (int c = 0; c < 3; ++c) p[c] = w ? static_cast<uint8_t>((sum[c] + w / 2) / w) : 0;
+				p[3] = static_cast<uint8_t>(std::min(w, 255));
+				holes += w == 0;
+			}
+		}
+		return coarse;
+	}
+
+	/// 粗い段からバイリニアで拡大した色
+	static uint8_t Upsample(const Level& coarse, int x, int y, int c) {
+		const int cy0 = y / 2, cy1 = (y & 1) ? std::min(cy0 + 1, coarse.height - 1) : std::max(cy0 - 1, 0);
+		const int cx0 = x / 2, cx1 = (x & 1) ? std::min(cx0 + 1, coarse.width - 1) : std::max(cx0 - 1, 0);
+		return static_cast<uint8_t>((coarse.at(cx0, cy0)[c] * 9 + coarse.at(cx1, cy0)[c] * 3 + coarse.at(cx0, cy1)[c] * 3 + coarse.at(cx1, cy1)[c] + 8) >> 4);
+	}
+
+	/// 元の実装（1ピクセルずつ、1スレッド）
+	static void FillTransparent(const Image& image, const Image& alpha) {
+		const int width = static_cast<int>(image.width), height = static_cast<int>(image.height);
+		const int channel = static_cast<int>(image.channel), alphaChannel = static_cast<int>(alpha.channel);
+		size_t opaque = 0;
+		for (size_t i = 0; i < alpha.size(); i += alphaChannel) opaque += alpha.data()[i] > 0;
+		if (opaque == 0 || opaque == static_cast<size_t>(width) * height) return;
+
+		Level base{ width, height };
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				const size_t i = static_cast<size_t>(y) * width + x;
+				const auto p = base.at(x, y);
+				for (int c = 0; c < 3; ++c) p[c] = image.data()[i * channel + c];
+				p[3] = alpha.data()[i * alphaChannel] > 0 ? 255 : 0;
+			}
+		}
+		std::vector<Level> levels;
+		int holes = 0;
+		levels.push_back(Push(base, holes));
+		while (holes > 0 && (levels.back().width > 1 || levels.back().height > 1)) {
+			auto coarse = Push(levels.back(), holes);
+			levels.push_back(std::move(coarse));
+		}
+		for (size_t k = levels.size() - 1; k > 0; --k) {
+			auto& fine = levels[k - 1];
+			for (int y = 0; y < fine.height; ++y) {
+				for (int x = 0; x < fine.width; ++x) {
+					const auto q = fine.at(x, y);
+					const int w = q[3];
+					if (w == 255) continue;
+					for (int c = 0; c < 3; ++c) q[c] = static_cast<uint8_t>((q[c] * w + Upsample(levels[k], x, y, c) * (255 - w) + 127) / 255);
+					q[3] = 255;
+				}
+			}
+		}
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				const size_t i = static_cast<size_t>(y) * width + x;
+				if (alpha.data()[i * alphaChannel] > 0) continue;
+				for (int c = 0; c < 3; ++c) image.data()[i * channel + c] = Upsample(levels.front(), x, y, c);
+			}
+		}
+	}
+}
+
+/// 乱数で埋めた画像
+static Image Random(int width, int height, int channel, uint32_t seed) {
+	Image image(width, height, channel);
+	for (size_t i = 0; i < image.size(); ++i) {
+		seed = seed * 1664525 + 1013904223;
+		image.data()[i] = static_cast<uint8_t>(seed >> 24);
+	}
+	return image;
+}
+
+/// 穴の開いたアルファ（円の穴と、ところどころ1ピクセルの穴）
+static Image Holes(int width, int height, int channel, uint32_t seed) {
+	Image alpha(width, height, channel);
+	const int cx = width / 3, cy = height / 2, r = std::max(1, std::min(width, height) / 3);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			seed = seed * 1664525 + 1013904223;
+			const bool hole = (x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r || (seed >> 24) < 16;
+			for (int c = 0; c < channel; ++c) alpha.data()[(static_cast<size_t>(y) * width + x) * channel + c] = hole ? 0 : static_cast<uint8_t>(1 + (seed >> 25));
+		}
+	}
+	return alpha;
+}
+
+/// 複製
+static Image Clone(const Image& image) {
+	Image copy(static_cast<int>(image.width), static_cast<int>(image.height), static_cast<int>(image.channel));
+	std::memcpy(copy.data(), image.data(), image.size());
+	return copy;
+}
+
+/// 不透明なピクセルはそのまま、穴は元の実装と同じ色で埋まる
+static void TestMatchesReference() {
+	const int sizes[][2] = { { 1, 1 }, { 2, 1 }, { 1, 7 }, { 5, 3 }, { 17, 9 }, { 64, 64 }, { 67, 33 }, { 301, 127 } };
+	uint32_t seed = 1;
+	for (const auto& size : sizes) {
+		for (const int channel : { 3, 4 }) {
+			for (const int alphaChannel : { 1, 4 }) {
+				const auto source = Random(size[0], size[1], channel, ++seed);
+				const auto alpha = Holes(size[0], size[1], alphaChannel, ++seed);
+				const auto image = Clone(source), expected = Clone(source);
+				FillTransparent(image, alpha);
+				Reference::FillTransparent(expected, alpha);
+				CHECK(std::memcmp(image.data(), expected.data(), image.size()) == 0);
+
+				// 不透明なピクセルとRGB以外のチャンネルは書き換えない
+				int changed = 0;
+				for (size_t i = 0; i < source.size(); ++i) {
+					const size_t pixel = i / channel;
+					const bool opaque = alpha.data()[pixel * alphaChannel] > 0;
+					if ((opaque || i % channel >= 3) && image.data()[i] != source.data()[i]) ++changed;
+				}
+				CHECK(changed == 0);
+			}
+		}
+	}
+}
+
+/// 1色の不透明部分なら穴もその色
+static void TestSolidColor() {
+	const int width = 130, height = 70;
+	const Image image(width, height, 3);
+	for (size_t i = 0; i < image.size(); i += 3) {
+		image.data()[i + 0] = 10;
+		image.data()[i + 1] = 200;
+		image.data()[i + 2] = 77;
+	}
+	const auto alpha = Holes(width, height, 1, 99);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			if (alpha.data()[static_cast<size_t>(y) * width + x] == 0) std::memset(image.data() + (static_cast<size_t>(y) * width + x) * 3, 0, 3);
+		}
+	}
+	FillTransparent(image, alpha);
+	int wrong = 0;
+	for (size_t i = 0; i < image.size(); i += 3) {
+		wrong += image.data()[i + 0] != 10 || image.data()[i + 1] != 200 || image.data()[i + 2] != 77;
+	}
+	CHECK(wrong == 0);
+}
+
+/// 全部透明か全部不透明なら何もしない
+static void TestUniformAlpha() {
+	const auto source = Random(33, 21, 3, 7);
+	for (const uint8_t value : { 0, 255 }) {
+		const Image alpha(33, 21, 1);
+		std::memset(alpha.data(), value, alpha.size());
+		const auto image = Clone(source);
+		FillTransparent(image, alpha);
+		CHECK(std::memcmp(image.data(), source.data(), source.size()) == 0);
+	}
+}
+
+int main() {
+	TestMatchesReference();
+	TestSolidColor();
+	TestUniformAlpha();
+	FilterPlugIn::TerminateParallelFor();
+	return Test::Result("FillTransparentTest");
+}
@@ -0,0 +1,113 @@
+/**
+ * @file GenerateBench.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief スタブのバックエンドで生成全体の待ち時間を測るベンチマーク
+ * @note スタブのステップとロードの待ち時間は固定なので、それ以外（前後の処理やキューの往復）の分が見える
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "StableDiffusion.h"
+
+using StableDiffusion::Image;
+using StableDiffusion::Params;
+
+constexpr int kStepMs = 5;
+constexpr int kLoadMs = 200;
+constexpr int kRuns = 5;
+
+/// スタブの設定
+static Params StubParams(int width, int height) {
+	Params params;
+	params.backend = "stub";
+	params.stub_step_ms = kStepMs;
+	params.stub_load_ms = kLoadMs;
+	params.model_path = "stub.safetensors";
+	params.prompt = "benchmark";
+	params.sample_steps = 8;
+	params.seed = 1;
+	params.width = width;
+	params.height = height;
+	params.preload = false;
+	params.free_params_immediately = false; // 同梱のSDPlugin.iniと同じ（コンテキストを使い回す）
+	return params;
+}
+
+/// ミリ秒
+static double Milliseconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// 何回か測って最小と平均
+static void Report(const char* name, const std::vector<double>& times, double fixedMs) {
+	const auto minimum = *std::min_element(times.begin(), times.end());
+	double mean = 0.0;
+	for (auto t : times) mean += t;
+	mean /= times.size();
+	printf("%-36s min %8.2f ms  mean %8.2f ms  (stub wait %6.1f ms, overhead %6.2f ms)\n", name, minimum, mean, fixedMs, minimum - fixedMs);
+}
+
+/// 同期の生成
+static void BenchGenerate(const char* name, const Params& params) {
+	std::vector<double> times;
+	for (int i = 0; i < kRuns; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		auto images = StableDiffusion::Generate(params, Image(), [](int, int) { return true; });
+		times.push_back(Milliseconds(start));
+		if (images.empty()) printf("%s: generate failed\n", name);
+	}
+	Report(name, times, params.sample_steps * kStepMs);
+}
+
+/// ワーカー経由の生成（RunFilterと同じ流れ）
+static void BenchGenerateAsync(const char* name, const Params& params) {
+	std::vector<double> times;
+	for (int i = 0; i < kRuns; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		auto job = StableDiffusion::GenerateAsync(params, Image());
+		while (!job->Wait(std::chrono::milliseconds(16))) {}
+		times.push_back(Milliseconds(start));
+		if (job->Results().empty()) printf("%s: generate failed\n", name);
+	}
+	Report(name, times, params.sample_steps * kStepMs);
+}
+
+/// コンテキストのキャッシュ有り無しで、最初と2回目の生成（フィルタの実行やリスタート毎の待ち時間）
+static void BenchContextCache() {
+	for (const bool cache : { true, false }) {
+		StableDiffusion::Terminate(); // キャッシュを空に
+		auto params = StubParams(512, 512);
+		params.free_params_immediately = !cache;
+		StableDiffusion::Initialize("", params);
+
+		std::vector<double> times;
+		for (int i = 0; i < kRuns + 1; ++i) {
+			const auto start = std::chrono::steady_clock::now();
+			auto job = StableDiffusion::GenerateAsync(params, Image());
+			while (!job->Wait(std::chrono::milliseconds(16))) {}
+			times.push_back(Milliseconds(start));
+		}
+		const double fixedMs = params.sample_steps * kStepMs;
+		Report(cache ? "context cache: first run" : "no context cache: first run", { times.front() }, fixedMs + kLoadMs);
+		Report(cache ? "context cache: next runs" : "no context cache: next runs", { times.begin() + 1, times.end() }, fixedMs);
+	}
+}
+
+int main() {
+	printf("GenerateBench (stub: %d ms/step, %d ms/load, %d runs)\n", kStepMs, kLoadMs, kRuns);
+	BenchContextCache();
+	StableDiffusion::Terminate();
+	StableDiffusion::Initialize("", StubParams(512, 512));
+
+	// 最初の1回でロードが済むので、以降はキャッシュから
+	for (const auto& [width, height] : { std::pair{ 512, 512 }, std::pair{ 1000, 700 }, std::pair{ 2048, 2048 } }) {
+		char name[64];
+		snprintf(name, sizeof(name), "Generate %dx%d", width, height);
+		BenchGenerate(name, StubParams(width, height));
+		snprintf(name, sizeof(name), "GenerateAsync %dx%d", width, height);
+		BenchGenerateAsync(name, StubParams(width, height));
+	}
+
+	StableDiffusion::Terminate();
+	return 0;
+}
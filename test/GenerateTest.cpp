@@ -0,0 +1,105 @@
+/**
+ * @file GenerateTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 画像生成（Generate）のサイズ合わせのテスト
+ * @note スタブのバックエンドの模様は生成サイズとシードだけで決まるので、切り出しとリサイズを見分けられる
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "StableDiffusion.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+static Params StubParams(int width, int height) {
+	Params params;
+	params.backend = "stub";
+	params.stub_step_ms = 0;
+	params.model_path = "stub.safetensors";
+	params.prompt = "test";
+	params.sample_steps = 1;
+	params.seed = 1;
+	params.width = width;
+	params.height = height;
+	params.preload = false;
+	params.free_params_immediately = false;
+	params.vae_decode_only = false;
+	return params;
+}
+
+static Image GenerateOne(const Params& params, const Image& input = Image()) {
+	auto images = Generate(params, input, [](int, int) { return true; });
+	return images.empty() ? Image() : images.front();
+}
+
+/// 左上の一致
+static bool SameTopLeft(const Image& a, const Image& b, int width, int height) {
+	if (!a.data() || !b.data() || a.channel != b.channel) return false;
+	for (int y = 0; y < height; ++y) {
+		const auto pa = a.data() + static_cast<size_t>(y) * a.width * a.channel;
+		const auto pb = b.data() + static_cast<size_t>(y) * b.width * b.channel;
+		if (memcmp(pa, pb, static_cast<size_t>(width) * a.channel) != 0) return false;
+	}
+	return true;
+}
+
+/// native_resolutionが無効なら64の倍数で生成して1:1で切り出す
+static void TestCrop() {
+	const auto result = GenerateOne(StubParams(1000, 700));
+	const auto aligned = GenerateOne(StubParams(1024, 704));
+	CHECK(result.width == 1000 && result.height == 700);
+	CHECK(SameTopLeft(result, aligned, 1000, 700));
+}
+
+/// native_resolutionが有効ならバケットで生成してリサイズ
+static void TestNative() {
+	auto params = StubParams(1000, 700);
+	params.native_resolution = 512;
+	const auto result = GenerateOne(params);
+	CHECK(result.width == 1000 && result.height == 700);
+	CHECK(!SameTopLeft(result, GenerateOne(StubParams(1024, 704)), 1000, 700));
+}
+
+/// i2iの入力も1:1（端を伸ばして埋めるだけ、選択範囲の中はそのまま）
+static void TestInputPad() {
+	Image input(1000, 700, 3);
+	auto p = input.data();
+	for (int y = 0; y < 700; ++y) {
+		for (int x = 0; x < 1000; ++x, p += 3) {
+			p[0] = static_cast<uint8_t>(x);
+			p[1] = static_cast<uint8_t>(y);
+			p[2] = static_cast<uint8_t>(x ^ y);
+		}
+	}
+	auto params = StubParams(1000, 700);
+	params.mode = IMG2IMG;
+	params.strength = 0.0f; // スタブは入力をそのまま返す
+	const auto result = GenerateOne(params, input);
+	CHECK(SameTopLeft(result, input, 1000, 700));
+}
+
+/// タイル分割のt2iは全体の下地を描いてからタイル毎にi2i（まだ描いてない所が黒いままにならない）
+static void TestTiledBase() {
+	auto params = StubParams(1500, 1000);
+	params.tile_size = 512;
+	params.tile_overlap = 64;
+	params.tile_strength = 0.0f; // スタブは下地をそのまま返す
+	const auto result = GenerateOne(params);
+
+	auto baseParams = StubParams(1500, 1000);
+	baseParams.native_resolution = 512;
+	const auto base = GenerateOne(baseParams);
+	CHECK(result.width == 1500 && result.height == 1000);
+	CHECK(SameTopLeft(result, base, 1500, 1000));
+}
+
+int main() {
+	Initialize("", StubParams(64, 64));
+	TestCrop();
+	TestNative();
+	TestInputPad();
+	TestTiledBase();
+	Terminate();
+	return Test::Result("GenerateTest");
+}
@@ -0,0 +1,54 @@
+/**
+ * @file IniFileBench.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイルの読み込み（IniFile）のベンチマーク
+ * @note 引数で別のiniファイルを指定できる（省略時は同梱のSDPlugin.ini）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "StableDiffusion.h"
+#include "IniFile.h"
+#include "Bench.h"
+
+/// 1件分の結果を1行で
+static void Report(const char* name, const Bench::Result& result, int64_t bytes) {
+	printf("%-40s %9.3f us %9.1f MB/s %12llu cycles\n", name, result.seconds * 1e6,
+		bytes ? bytes / result.seconds * 1e-6 : 0.0, static_cast<unsigned long long>(result.cycles));
+}
+
+int main(int argc, char* argv[]) {
+	const std::string path = argc > 1 ? argv[1] : SDPLUGIN_INI;
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		printf("cannot open %s\n", path.c_str());
+		return 1;
+	}
+	const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const auto bytes = static_cast<int64_t>(text.size());
+
+	Bench::Cycles cycles;
+	printf("IniFileBench %s (%lld bytes, cycles: %s)\n", path.c_str(), static_cast<long long>(bytes), cycles.source());
+
+	// 文字列から表を作る
+	IniFile::Table table;
+	Report("parse", Bench::Measure(cycles, [&] { table.Parse(text); }), bytes);
+
+	// 読み込み済みの表を引く（更新日時とサイズを見るだけ）
+	Report("load (cached)", Bench::Measure(cycles, [&] { IniFile::Load(path); }), 0);
+
+	// 全キーを引く（COMMONと設定1つ分、設定を切り替える時と同じ）
+	const auto section = table.Sections().size() > 1 ? table.Sections()[1] : std::string("COMMON");
+	Report("params (COMMON + section)", Bench::Measure(cycles, [&] {
+		StableDiffusion::LoadParams(table, section, StableDiffusion::LoadParams(table, "COMMON"));
+	}), 0);
+
+	// 全設定を読み直す（Configの再読み込みと同じ）
+	Report("params (all sections)", Bench::Measure(cycles, [&] {
+		const auto common = StableDiffusion::LoadParams(table, "COMMON");
+		for (const auto& name : table.Sections()) {
+			if (name != "COMMON") StableDiffusion::LoadParams(table, name, common);
+		}
+	}), 0);
+	return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file IniFileTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 設定ファイルの読み込み（IniFile）のテスト
+ */
+#include "pch.h"
+
+#include "IniFile.h"
+#include "Test.h"
+
+/// 値の確認
+/// @return keyがあってexpectedと同じならtrue
+static bool Is(const IniFile::Table& table, const char* section, const char* key, const char* expected) {
+	const auto value = table.Find(section, key);
+	return value && *value == expected;
+}
+
+/// コメント
+static void TestComments() {
+	IniFile::Table table;
+	table.Parse(
+		"; 先頭のコメント\n"
+		"# こちらも\n"
+		"[test]\n"
+		"  ; 字下げしたコメント\n"
+		"a = 1 ; 後ろのコメント\n"
+		"b = 2 # こちらも\n"
+		";c = 3\n"
+		"d = ; 値なし\n");
+	CHECK(Is(table, "test", "a", "1"));
+	CHECK(Is(table, "test", "b", "2"));
+	CHECK(!table.Find("test", "c"));
+	CHECK(Is(table, "test", "d", ""));
+}
+
+/// 前後の空白（コメントを削った後も削る）
+/// @note 以前はコメントの前の空白が値に残っていたので「schedule = karras ; ...」はどれにも一致しなかった
+static void TestTrimming() {
+	IniFile::Table table;
+	table.Parse(
+		"\xEF\xBB\xBF[ test ]\r\n"
+		"\tkey\t=\tvalue\t\r\n"
+		"schedule = karras ; コメント\r\n"
+		"spaced =   a b c   \r\n");
+	CHECK(Is(table, "test", "key", "value"));
+	CHECK(Is(table, "test", "schedule", "karras"));
+	CHECK(Is(table, "test", "spaced", "a b c"));
+	CHECK(table.Sections().size() == 1 && table.Sections()[0] == "test");
+}
+
+/// アンクォート
+static void TestQuoted() {
+	IniFile::Table table;
+	table.Parse(
+		"[test]\n"
+		"path = \"C:\\models\\sd.safetensors\"\n"
+		"space = \"  keep  \"\n"
+		"comment = \"quoted\" ; コメント\n"
+		"half = \"open\n"
+		"empty = \"\"\n");
+	CHECK(Is(table, "test", "path", "C:\\models\\sd.safetensors"));
+	CHECK(Is(table, "test", "space", "  keep  "));
+	CHECK(Is(table, "test", "comment", "quoted"));
+	CHECK(Is(table, "test", "half", "\"open"));
+	CHECK(Is(table, "test", "empty", ""));
+}
+
+/// 無いセクションとキー
+static void TestMissing() {
+	IniFile::Table table;
+	table.Parse(
+		"orphan = 1\n" // セクションより前のキーは無視
+		"[test]\n"
+		"a = 1\n"
+		"no equal\n"
+		" = no key\n");
+	CHECK(!table.Find("", "orphan"));
+	CHECK(!table.Find("none", "a"));
+	CHECK(!table.Find("test", "b"));
+	CHECK(!table.Find("test", "no equal"));
+	CHECK(!table.Find("test", ""));
+	CHECK(table.Sections().size() == 1);
+
+	IniFile::Table empty;
+	empty.Parse("");
+	CHECK(empty.Sections().empty());
+	CHECK(!empty.Find("test", "a"));
+}
+
+/// 大文字小文字と重複
+static void TestCaseAndDuplicates() {
+	IniFile::Table table;
+	table.Parse(
+		"[COMMON]\n"
+		"Model_Path = first\n"
+		"model_path = second\n" // 同じキーは最初のものが有効
+		"[test]\n"
+		"a = 1\n"
+		"[common]\n"
+		"extra = 2\n"); // 同じセクションは続きとして扱う
+	CHECK(Is(table, "common", "MODEL_PATH", "first"));
+	CHECK(Is(table, "Common", "extra", "2"));
+	CHECK(table.Sections().size() == 2);
+	CHECK(table.Sections()[0] == "COMMON" && table.Sections()[1] == "test");
+
+	// 読み直すと前の内容は消える
+	table.Parse("[other]\nb = 2\n");
+	CHECK(!table.Find("test", "a"));
+	CHECK(Is(table, "other", "b", "2"));
+}
+
+/// ファイルからの読み込み（更新されるまで使い回す）
+static void TestLoad() {
+	const auto dir = std::filesystem::temp_directory_path() / "sdplugin_inifile_test";
+	std::filesystem::create_directories(dir);
+	const auto path = (dir / "test.ini").string();
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << "[test]\na = 1\n";
+	}
+	const auto first = IniFile::Load(path);
+	CHECK(Is(*first, "test", "a", "1"));
+	CHECK(IniFile::Load(path) == first);
+
+	// サイズが変われば読み直す
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << "[test]\na = 22\n";
+	}
+	const auto second = IniFile::Load(path);
+	CHECK(second != first);
+	CHECK(Is(*second, "test", "a", "22"));
+	CHECK(Is(*first, "test", "a", "1")); // 前の表は持っている側で生きている
+
+	// 無いファイルは空の表
+	const auto missing = IniFile::Load((dir / "missing.ini").string());
+	CHECK(missing && missing->Sections().empty());
+
+	std::error_code error;
+	std::filesystem::remove_all(dir, error);
+}
+
+int main() {
+	TestComments();
+	TestTrimming();
+	TestQuoted();
+	TestMissing();
+	TestCaseAndDuplicates();
+	TestLoad();
+	return Test::Result("IniFileTest");
+}
@@ -0,0 +1,72 @@
+/**
+ * @file LoggerTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief デバッグログの書き出し（Logger）のテスト
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Logger.h"
+#include "Test.h"
+
+/// Logger::Writeを可変長引数で
+static void Write(LogLevel level, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	Logger::Write(level, format, args);
+	va_end(args);
+}
+
+/// ファイルの行
+static std::vector<std::string> ReadLines(const std::filesystem::path& path) {
+	std::vector<std::string> lines;
+	std::ifstream file(path, std::ios::binary);
+	for (std::string line; std::getline(file, line);) lines.push_back(line);
+	return lines;
+}
+
+/// 行頭にレベルのタグ
+static void TestTags() {
+	const auto dir = std::filesystem::temp_directory_path() / "sdplugin_logger_test";
+	std::filesystem::create_directories(dir);
+	const auto path = dir / "debuglog.txt";
+
+	Logger::Open(path.string());
+	Logger::Configure(LOG_DEBUG, 0);
+	Write(LOG_ERROR, "error %d", 1);
+	Write(LOG_WARN, "warn %s", "2");
+	Write(LOG_INFO, "info");
+	Write(LOG_DEBUG, "debug");
+	Logger::Terminate();
+
+	const auto lines = ReadLines(path);
+	CHECK(lines.size() == 4);
+	if (lines.size() == 4) {
+		CHECK(lines[0] == "[E] error 1");
+		CHECK(lines[1] == "[W] warn 2");
+		CHECK(lines[2] == "[I] info");
+		CHECK(lines[3] == "[D] debug");
+	}
+
+	// 捨てるレベルは書かない、長い行はタグ込みで切り詰める
+	Logger::Open(path.string());
+	Logger::Configure(LOG_WARN, 0);
+	Write(LOG_INFO, "info");
+	Write(LOG_WARN, "%s", std::string(10000, 'x').c_str());
+	Logger::Terminate();
+
+	const auto trimmed = ReadLines(path);
+	CHECK(trimmed.size() == 1);
+	if (trimmed.size() == 1) {
+		CHECK(trimmed[0].rfind("[W] xxx", 0) == 0);
+		CHECK(trimmed[0].size() < 2048);
+	}
+
+	std::error_code error;
+	std::filesystem::remove_all(dir, error);
+}
+
+int main() {
+	TestTags();
+	return Test::Result("LoggerTest");
+}
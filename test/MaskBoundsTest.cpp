@@ -0,0 +1,100 @@
+/**
+ * @file MaskBoundsTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief マスクの範囲（MaskBounds）のテスト
+ * @note ホストの選択範囲ブロックはneedOffset無しで、アドレスはブロックの左上を指す
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "Test.h"
+
+using namespace FilterPlugIn;
+
+/// ホストのブロックの真似（原点から離れた位置の256x256）
+struct HostBlock {
+	static constexpr Int kSize = 256;
+	static constexpr Int kLeft = 512, kTop = 768;
+	std::vector<uint8_t> pixels = std::vector<uint8_t>(kSize * kSize, 0);
+
+	Block block() {
+		return Block{ .rect{ kLeft, kTop, kLeft + kSize, kTop + kSize }, .address{ pixels.data() },
+			.rowBytes{ kSize }, .pixelBytes{ 1 }, .r{0}, .g{0}, .b{0}, .needOffset{ false } };
+	}
+	/// ブロック内座標で塗る
+	void fill(Int left, Int top, Int right, Int bottom) {
+		for (Int y = top; y < bottom; ++y) for (Int x = left; x < right; ++x) pixels[y * kSize + x] = 255;
+	}
+	/// ブロック内座標から画像座標の矩形
+	static Rect at(Int left, Int top, Int right, Int bottom) {
+		return { kLeft + left, kTop + top, kLeft + right, kTop + bottom };
+	}
+};
+
+static bool SameRect(const Rect& a, const Rect& b) {
+	return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+static bool EmptyRect(const Rect& r) {
+	return r.left >= r.right || r.top >= r.bottom;
+}
+
+/// ブロック全体
+static void TestWholeBlock() {
+	HostBlock host;
+	host.fill(200, 150, 210, 160);
+	const auto block = host.block();
+	CHECK(SameRect(MaskBounds(block, block.rect), HostBlock::at(200, 150, 210, 160)));
+}
+
+/// 島探しのセル（32px）：自分のセルで見つかって、他のセルに幽霊が出ない
+static void TestCells() {
+	HostBlock host;
+	host.fill(200, 150, 210, 160);
+	host.fill(5, 5, 6, 6);
+	const auto block = host.block();
+	CHECK(SameRect(MaskBounds(block, HostBlock::at(192, 128, 224, 160)), HostBlock::at(200, 150, 210, 160)));
+	CHECK(SameRect(MaskBounds(block, HostBlock::at(0, 0, 32, 32)), HostBlock::at(5, 5, 6, 6)));
+
+	// 何も無いセルは全部空
+	int hits = 0;
+	for (Int y = 0; y < HostBlock::kSize; y += 32) {
+		for (Int x = 0; x < HostBlock::kSize; x += 32) {
+			if (!EmptyRect(MaskBounds(block, HostBlock::at(x, y, x + 32, y + 32)))) ++hits;
+		}
+	}
+	CHECK(hits == 2);
+}
+
+/// 切り抜き（ブロックの一部だけの選択範囲）：原点から離れた所
+static void TestCrop() {
+	HostBlock host;
+	host.fill(100, 60, 140, 90);
+	const auto block = host.block();
+
+	// 選択範囲がブロックの途中から始まる
+	CHECK(SameRect(MaskBounds(block, HostBlock::at(64, 32, 256, 256)), HostBlock::at(100, 60, 140, 90)));
+	// マスクの途中で切れる
+	CHECK(SameRect(MaskBounds(block, HostBlock::at(120, 70, 200, 200)), HostBlock::at(120, 70, 140, 90)));
+	// マスクに掛からない
+	CHECK(EmptyRect(MaskBounds(block, HostBlock::at(150, 100, 256, 256))));
+	// ブロックからはみ出す矩形はブロックと重なる所だけ
+	CHECK(SameRect(MaskBounds(block, Rect{ 0, 0, 4096, 4096 }), HostBlock::at(100, 60, 140, 90)));
+}
+
+/// 画像側のブロック（needOffset有り）も同じ結果
+static void TestImageBlock() {
+	HostBlock host;
+	host.fill(100, 60, 140, 90);
+	auto block = host.block();
+	block.needOffset = true;
+	CHECK(SameRect(MaskBounds(block, HostBlock::at(64, 32, 256, 256)), HostBlock::at(100, 60, 140, 90)));
+}
+
+int main() {
+	TestWholeBlock();
+	TestCells();
+	TestCrop();
+	TestImageBlock();
+	return Test::Result("MaskBoundsTest");
+}
@@ -0,0 +1,92 @@
+/**
+ * @file MetricsTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 実行統計（Metrics）のテスト
+ * @note ステップ時間はスタブのバックエンドのジョブから取る
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "StableDiffusion.h"
+#include "Metrics.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+static Params StubParams() {
+	Params params;
+	params.backend = "stub";
+	params.stub_step_ms = 1;
+	params.model_path = "stub.safetensors";
+	params.prompt = "test";
+	params.sample_steps = 6;
+	params.seed = 1;
+	params.width = 64;
+	params.height = 64;
+	params.preload = false;
+	params.free_params_immediately = false;
+	return params;
+}
+
+/// 完了待ち
+static std::shared_ptr<Job> Run(const Params& params) {
+	auto job = GenerateAsync(params, Image());
+	while (!job->Wait(std::chrono::milliseconds(16))) {}
+	return job;
+}
+
+/// ステップ時間はジョブに残るだけで、使う側が渡すまで数えない
+static void TestStepAttribution() {
+	const auto params = StubParams();
+	const auto job = Run(params);
+	CHECK(!job->Results().empty());
+	CHECK(static_cast<int>(job->StepSeconds().size()) == params.sample_steps);
+
+	// 投機的生成が捨てられた時と同じ（結果を使わない）
+	Metrics::BeginRun();
+	Run(params);
+	Metrics::EndRun(0.1);
+	CHECK(Metrics::Summary().rfind("last run: cached", 0) == 0);
+
+	// 結果を使えば数える
+	Metrics::BeginRun();
+	Metrics::Steps(Run(params)->StepSeconds());
+	Metrics::EndRun(0.1);
+	CHECK(Metrics::Summary().find("it/s") != std::string::npos);
+
+	// 中断されたジョブは空
+	auto cancelled = std::make_shared<Job>(params, Image());
+	cancelled->Cancel();
+	cancelled->Finish({});
+	CHECK(cancelled->StepSeconds().empty());
+}
+
+/// ピークは実行中に測った値の最大
+static void TestPeakMemory() {
+	constexpr size_t kBytes = 512ull << 20;
+	double gb = 0.0;
+
+	Metrics::BeginRun();
+	{
+		std::vector<uint8_t> buffer(kBytes, 1); // 全部触って常駐させる
+		CHECK(Metrics::CurrentMemoryBytes() >= kBytes);
+		Metrics::SampleMemory();
+	}
+	Metrics::EndRun(0.1);
+	CHECK(sscanf(Metrics::Summary().c_str(), "last run: cached, %lf GB peak", &gb) == 1);
+	CHECK(gb >= 0.5);
+
+	// 次の実行には持ち越さない
+	Metrics::BeginRun();
+	Metrics::EndRun(0.1);
+	CHECK(sscanf(Metrics::Summary().c_str(), "last run: cached, %lf GB peak", &gb) == 1);
+	CHECK(gb < 0.5);
+}
+
+int main() {
+	Initialize("", StubParams());
+	TestStepAttribution();
+	TestPeakMemory();
+	Terminate();
+	return Test::Result("MetricsTest");
+}
@@ -0,0 +1,78 @@
+/**
+ * @file ParallelForTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 並列処理（ParallelFor）のテスト
+ */
+#include "pch.h"
+#include <set>
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "Test.h"
+
+using namespace FilterPlugIn;
+
+/// 全部のインデックスがちょうど1回ずつ処理される
+static bool RunOnce(size_t count) {
+	std::vector<std::atomic<int>> hits(count);
+	ParallelFor(count, [&](size_t i) { ++hits[i]; });
+	return std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& hit) { return hit == 1; });
+}
+
+/// 何回呼んでも同じワーカーで処理される
+static void TestRepeated() {
+	for (int i = 0; i < 1000; ++i) {
+		if (!RunOnce(static_cast<size_t>(i % 67))) {
+			CHECK(false);
+			return;
+		}
+	}
+	std::mutex mutex;
+	std::set<std::thread::id> ids;
+	for (int i = 0; i < 20; ++i) {
+		ParallelFor(256, [&](size_t) {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			std::lock_guard lock(mutex);
+			ids.insert(std::this_thread::get_id());
+		});
+	}
+	CHECK(ids.size() <= std::max(1u, std::thread::hardware_concurrency())); // 呼び出し毎に立て直していない
+}
+
+/// 入れ子と、別のスレッドからの同時呼び出し
+static void TestNestedAndConcurrent() {
+	std::atomic<int> total{ 0 };
+	ParallelFor(8, [&](size_t) {
+		ParallelFor(8, [&](size_t) { ++total; });
+	});
+	CHECK(total == 64);
+
+	std::atomic<bool> ok{ true };
+	std::vector<std::thread> callers;
+	for (int t = 0; t < 4; ++t) {
+		callers.emplace_back([&] {
+			for (int i = 0; i < 100; ++i) {
+				if (!RunOnce(97)) ok = false;
+			}
+		});
+	}
+	for (auto& caller : callers) caller.join();
+	CHECK(ok);
+}
+
+/// 停止した後も次の呼び出しでまた使える
+static void TestTerminate() {
+	TerminateParallelFor();
+	CHECK(RunOnce(100));
+	TerminateParallelFor();
+	TerminateParallelFor();
+	CHECK(RunOnce(3));
+}
+
+int main() {
+	TestRepeated();
+	TestNestedAndConcurrent();
+	TestTerminate();
+	TerminateParallelFor();
+	return Test::Result("ParallelForTest");
+}
@@ -0,0 +1,36 @@
+/**
+ * @file ParamsTableTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 生成パラメータのフィールド表（ParamsTable）のテスト
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "ParamsTable.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+/// ダイアログのプロパティは1フィールドに1つ、扱える型（int、float、文字列）だけ
+static void TestPropertyKeys() {
+	std::vector<int> keys;
+	ParamsTable::ForEach([&](const auto& field) {
+		if (field.property == ParamsTable::NO_PROPERTY) return;
+		using T = std::remove_cvref_t<decltype(std::declval<Params>().*field.member)>;
+		CHECK((std::is_same_v<T, int> || std::is_same_v<T, float> || std::is_same_v<T, std::string>));
+		CHECK(std::find(keys.begin(), keys.end(), field.property) == keys.end());
+		keys.push_back(field.property);
+	});
+	for (const auto key : { ParamsTable::ITEM_STEPS, ParamsTable::ITEM_STRENGTH, ParamsTable::ITEM_CONTROL_STRENGTH,
+		ParamsTable::ITEM_PROMPT, ParamsTable::ITEM_NPROMPT, ParamsTable::ITEM_BATCH_COUNT }) {
+		CHECK(std::find(keys.begin(), keys.end(), key) != keys.end());
+	}
+	// 設定の選択と統計は生成パラメータではない
+	CHECK(std::find(keys.begin(), keys.end(), ParamsTable::ITEM_SETTING) == keys.end());
+	CHECK(std::find(keys.begin(), keys.end(), ParamsTable::ITEM_METRICS) == keys.end());
+}
+
+int main() {
+	TestPropertyKeys();
+	return Test::Result("ParamsTableTest");
+}
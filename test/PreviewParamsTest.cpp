@@ -0,0 +1,87 @@
+/**
+ * @file PreviewParamsTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief プレビュー用の生成パラメータ（PreviewParams）のテスト
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "StableDiffusion.h"
+#include "ParamsTable.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+static Params BaseParams() {
+	Params params;
+	params.model_path = "model.safetensors";
+	params.taesd_path = "taesd.safetensors";
+	params.prompt = "test";
+	params.width = 1000;
+	params.height = 700;
+	params.sample_steps = 20;
+	params.preview = true;
+	return params;
+}
+
+/// モデル関係は本番と同じ（同じコンテキストで描ける）
+static void TestSameModel() {
+	for (const auto mode : { TXT2IMG, IMG2IMG, CONTROL }) {
+		auto params = BaseParams();
+		params.mode = mode;
+		const auto preview = PreviewParams(params);
+		CHECK(!(ParamsTable::DiffFields(params, preview) & ParamsTable::MODEL));
+		CHECK(preview.taesd_path == params.taesd_path);
+	}
+}
+
+/// 生成結果に関係するところだけ軽くする
+static void TestResultFields() {
+	const auto params = BaseParams();
+	const auto preview = PreviewParams(params);
+	CHECK(ParamsTable::DiffFields(params, preview) & ParamsTable::RESULT);
+	CHECK(!preview.preview);
+	CHECK(preview.native_resolution == params.preview_resolution);
+	CHECK(preview.sample_steps == params.preview_steps);
+	CHECK(preview.sample_method == params.preview_sample_method);
+	CHECK(preview.cfg_scale == params.preview_cfg_scale);
+	CHECK(preview.batch_count == 1);
+	CHECK(preview.tile_size == 0);
+}
+
+/// 本番がタイル分割ならタイルのコンテキスト（エンコード有り）に合わせる
+static void TestTiled() {
+	auto params = BaseParams();
+	params.tile_size = 512;
+	params.vae_decode_only = true;
+	auto tileContext = params;
+	tileContext.vae_decode_only = false;
+	CHECK(!(ParamsTable::DiffFields(tileContext, PreviewParams(params)) & ParamsTable::MODEL));
+
+	// タイルに収まれば分割しないのでそのまま
+	params.tile_size = 1024;
+	CHECK(PreviewParams(params).vae_decode_only);
+}
+
+/// preview_taesd_pathはTAESDだけ差し替える（本番と両方置ける時だけ）
+static void TestPreviewTaesd() {
+	auto params = BaseParams();
+	params.preview_taesd_path = "taesd_preview.safetensors";
+	params.max_resident_models = 2;
+	auto preview = PreviewParams(params);
+	CHECK(preview.taesd_path == params.preview_taesd_path);
+	preview.taesd_path = params.taesd_path;
+	CHECK(!(ParamsTable::DiffFields(params, preview) & ParamsTable::MODEL));
+
+	// 1つしか置けなければ本番と同じコンテキストのまま
+	params.max_resident_models = 1;
+	CHECK(PreviewParams(params).taesd_path == params.taesd_path);
+}
+
+int main() {
+	TestSameModel();
+	TestResultFields();
+	TestTiled();
+	TestPreviewTaesd();
+	return Test::Result("PreviewParamsTest");
+}
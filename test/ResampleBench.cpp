@@ -0,0 +1,53 @@
+/**
+ * @file ResampleBench.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief リサイズ（ImageProcessのResize）のベンチマーク
+ * @note 8K（7680x4320）とモデルの生成サイズ（SDXLのバケット）の間の拡大縮小
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "ImageProcess.h"
+#include "Bench.h"
+
+using namespace StableDiffusion;
+
+/// 模様の画像（グラデーションに細かい格子）
+static Image Pattern(int width, int height) {
+	Image image(width, height, 3);
+	auto p = image.data();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x, p += 3) {
+			p[0] = static_cast<uint8_t>(x * 255 / width);
+			p[1] = static_cast<uint8_t>(y * 255 / height);
+			p[2] = ((x ^ y) & 8) ? 255 : 0;
+		}
+	}
+	return image;
+}
+
+/// 1つのリサイズを計測（出力ピクセルあたり）
+static void BenchResize(Bench::Cycles& cycles, const Image& source, int width, int height, ResizeFilter filter) {
+	char name[64];
+	snprintf(name, sizeof(name), "%s %dx%d -> %dx%d", filter == LANCZOS ? "lanczos" : "bicubic",
+		static_cast<int>(source.width), static_cast<int>(source.height), width, height);
+	const int64_t pixels = static_cast<int64_t>(width) * height;
+	const int64_t bytes = static_cast<int64_t>(source.size()) + pixels * 3;
+	Bench::Report(name, Bench::Measure(cycles, [&] { Resize(source, width, height, filter); }, 1.0), pixels, bytes);
+}
+
+int main() {
+	Bench::Cycles cycles;
+	printf("ResampleBench (cycles: %s)\n", cycles.source());
+	const auto uhd8k = Pattern(7680, 4320);
+	const auto bucket = Pattern(1344, 768);
+	for (const auto filter : { LANCZOS, BICUBIC }) {
+		BenchResize(cycles, uhd8k, 1344, 768, filter);  // 8Kの選択範囲を生成サイズに（i2iの入力）
+		BenchResize(cycles, bucket, 7680, 4320, filter); // 生成結果を8Kの選択範囲に
+		BenchResize(cycles, uhd8k, 3840, 2160, filter);  // 半分
+		BenchResize(cycles, uhd8k, 7000, 4000, filter);  // ほぼ等倍
+	}
+	FilterPlugIn::TerminateParallelFor();
+	return 0;
+}
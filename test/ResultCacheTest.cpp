@@ -0,0 +1,66 @@
+/**
+ * @file ResultCacheTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief 生成結果キャッシュのキー（ResultCache::MakeKey）のテスト
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "ResultCache.h"
+#include "Test.h"
+
+using namespace StableDiffusion;
+
+static Params BaseParams() {
+	Params params;
+	params.model_path = "model.safetensors";
+	params.prompt = "test";
+	params.seed = 1;
+	return params;
+}
+
+/// 生成結果に関係するものはキーが変わる
+static void TestResultFields() {
+	const auto base = BaseParams();
+	const auto key = ResultCache::MakeKey(base, 0);
+	CHECK(key != 0);
+
+	auto other = base;
+	other.prompt = "other";
+	CHECK(ResultCache::MakeKey(other, 0) != key);
+
+	// スタブの結果を本物のDLLの結果として使わない
+	other = base;
+	other.backend = "stub";
+	CHECK(ResultCache::MakeKey(other, 0) != key);
+
+	other = base;
+	other.stub_step_ms = base.stub_step_ms + 1;
+	CHECK(ResultCache::MakeKey(other, 0) != key);
+}
+
+/// 動作オプションではキーが変わらない
+static void TestOptionFields() {
+	const auto base = BaseParams();
+	const auto key = ResultCache::MakeKey(base, 0);
+
+	auto other = base;
+	other.verbose = !base.verbose;
+	other.result_cache_mb = base.result_cache_mb + 1;
+	other.preload = !base.preload;
+	CHECK(ResultCache::MakeKey(other, 0) == key);
+}
+
+/// ランダムシードはキャッシュしない
+static void TestRandomSeed() {
+	auto params = BaseParams();
+	params.seed = -1;
+	CHECK(ResultCache::MakeKey(params, 0) == 0);
+}
+
+int main() {
+	TestResultFields();
+	TestOptionFields();
+	TestRandomSeed();
+	return Test::Result("ResultCacheTest");
+}
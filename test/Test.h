@@ -0,0 +1,24 @@
+/**
+ * @file Test.h
+ * @author 青猫 (AonekoSS)
+ * @brief テスト用の最小限の仕組み（プラグイン本体はホスト無しで動かないので、移植できる部分だけ）
+ */
+#pragma once
+#include <cstdio>
+
+namespace Test {
+	/// 失敗した数
+	extern int failures;
+
+	/// 結果の出力
+	/// @return 全部通ればmainの戻り値として0
+	inline int Result(const char* name) {
+		printf("%s: %s (%d failures)\n", name, failures ? "FAILED" : "OK", failures);
+		return failures ? 1 : 0;
+	}
+}
+
+/// 条件の確認（失敗しても続ける）
+#define CHECK(expr) do { \
+	if (!(expr)) { ++Test::failures; printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); } \
+} while (0)
@@ -0,0 +1,33 @@
+/**
+ * @file TestSupport.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief テストとベンチマークの共通部分（SDPlugin.cppの代わり）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "Test.h"
+
+namespace Test {
+	int failures = 0;
+}
+
+/// デバッグ出力（SDPLUGIN_TEST_LOGがあれば標準エラーに）
+static void vprint(const char* format, va_list args) {
+	static const bool enabled = getenv("SDPLUGIN_TEST_LOG") != nullptr;
+	if (!enabled) return;
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+}
+void print(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vprint(format, args);
+	va_end(args);
+}
+void print(LogLevel level, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vprint(format, args);
+	va_end(args);
+}
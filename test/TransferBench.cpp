@@ -0,0 +1,129 @@
+/**
+ * @file TransferBench.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief ブロック転送（Transfer）と取り込み／書き出しのベンチマーク
+ * @note ホストのオフスクリーンの代わりに、タイル毎に別々に確保したブロックを使う
+ * @note 使い方: TransferBench [キャンバスの辺] [ブロックの辺]（省略時は2048と8Kのキャンバスで決まった組み合わせを全部）
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "StableDiffusion.h"
+#include "Bench.h"
+
+using namespace FilterPlugIn;
+using StableDiffusion::Image;
+
+/// ホストのブロックの並び
+struct ChannelOrder {
+	const char* name;
+	Int r, g, b;
+};
+constexpr ChannelOrder kBGRA{ "BGRA", 2, 1, 0 };
+constexpr ChannelOrder kRGBA{ "RGBA", 0, 1, 2 };
+
+/// ホストのオフスクリーンの真似（ブロック毎に別の領域、行末に余りあり）
+class HostCanvas {
+public:
+	static constexpr Int kRowPadding = 64;
+
+	HostCanvas(Int size, Int blockSize, const ChannelOrder& order) {
+		uint32_t seed = 1;
+		auto random = [&seed] { seed = seed * 1664525 + 1013904223; return static_cast<uint8_t>(seed >> 24); };
+		for (Int top = 0; top < size; top += blockSize) {
+			for (Int left = 0; left < size; left += blockSize) {
+				const Rect rect{ left, top, std::min(left + blockSize, size), std::min(top + blockSize, size) };
+				const Int width = rect.right - rect.left, height = rect.bottom - rect.top;
+				auto& tile = tiles.emplace_back();
+				tile.image.resize(static_cast<size_t>(width * 4 + kRowPadding) * height);
+				tile.alpha.resize(static_cast<size_t>(width + kRowPadding) * height);
+				tile.select.resize(static_cast<size_t>(width + kRowPadding) * height);
+				for (auto& v : tile.image) v = random();
+				for (auto& v : tile.alpha) v = random() < 32 ? 0 : 255;   // 透明な所が少しある
+				for (auto& v : tile.select) v = random();                 // 選択範囲はぼかし有り
+				tile.blocks = {
+					Block{ rect, tile.image.data(), width * 4 + kRowPadding, 4, order.r, order.g, order.b, false },
+					Block{ rect, tile.alpha.data(), width + kRowPadding, 1, 0, 0, 0, false },
+					Block{ rect, tile.select.data(), width + kRowPadding, 1, 0, 0, 0, false },
+				};
+			}
+		}
+	}
+
+	struct Tile {
+		std::vector<uint8_t> image, alpha, select;
+		std::array<Block, 3> blocks; // 画像、アルファ、選択範囲
+		const Block& imageBlock() const { return blocks[0]; }
+		const Block& alphaBlock() const { return blocks[1]; }
+		const Block& selectBlock() const { return blocks[2]; }
+	};
+	std::vector<Tile> tiles;
+};
+
+/// 画像からブロック（SDPlugin.cppのImageToBlockと同じ）
+static Block ImageToBlock(const Image& image, int x, int y) {
+	return Block{
+		.rect{ x, y, static_cast<Int>(image.width) + x, static_cast<Int>(image.height) + y},
+		.address{ image.data() },
+		.rowBytes{ static_cast<Int>(image.width) * static_cast<Int>(image.channel)},
+		.pixelBytes{ static_cast<Int>(image.channel) }, .r{0}, .g{1}, .b{2},
+		.needOffset{true}
+	};
+}
+
+/// 1つのキャンバスとブロックサイズで全部
+static void RunCanvas(Bench::Cycles& cycles, Int size, Int blockSize, const ChannelOrder& order) {
+	HostCanvas canvas(size, blockSize, order);
+	Image image(size, size, 3);
+	memset(image.data(), 128, image.size());
+	const int64_t pixels = static_cast<int64_t>(size) * size;
+	const auto& tiles = canvas.tiles;
+	char label[64];
+	auto name = [&](const char* what) {
+		snprintf(label, sizeof(label), "%s %d/%d %s", what, static_cast<int>(size), static_cast<int>(blockSize), order.name);
+		return std::string(label);
+	};
+
+	// 取り込み（ホストの4バイト→3バイトRGB）
+	Bench::Report(name("capture serial"), Bench::Measure(cycles, [&] {
+		const auto block = ImageToBlock(image, 0, 0);
+		for (const auto& tile : tiles) Transfer(block, tile.imageBlock());
+	}), pixels, pixels * (4 + 3));
+	Bench::Report(name("capture parallel"), Bench::Measure(cycles, [&] {
+		const auto block = ImageToBlock(image, 0, 0);
+		ParallelFor(tiles.size(), [&](size_t i) { Transfer(block, tiles[i].imageBlock()); });
+	}), pixels, pixels * (4 + 3));
+
+	// 書き出し（3バイトRGB→ホストの4バイト、透明な所は書かない）
+	Bench::Report(name("write back alpha"), Bench::Measure(cycles, [&] {
+		const auto block = ImageToBlock(image, 0, 0);
+		ParallelFor(tiles.size(), [&](size_t i) { Transfer(tiles[i].imageBlock(), block, tiles[i].alphaBlock()); });
+	}), pixels, pixels * (3 + 1 + 4 * 2));
+
+	// 書き出し（選択範囲でブレンド）
+	Bench::Report(name("write back select"), Bench::Measure(cycles, [&] {
+		const auto block = ImageToBlock(image, 0, 0);
+		ParallelFor(tiles.size(), [&](size_t i) { Transfer(tiles[i].imageBlock(), block, tiles[i].alphaBlock(), tiles[i].selectBlock()); });
+	}), pixels, pixels * (3 + 1 + 1 + 4 * 2));
+}
+
+int main(int argc, char* argv[]) {
+	Bench::Cycles cycles;
+	printf("TransferBench (cycles: %s, threads: %u)\n", cycles.source(), std::thread::hardware_concurrency());
+	if (argc >= 3) {
+		RunCanvas(cycles, atoi(argv[1]), atoi(argv[2]), kBGRA);
+		TerminateParallelFor();
+		return 0;
+	}
+	// 並列処理の呼び出し1回分のコスト（中身は空、転送や書き出しの度に掛かる分）
+	Bench::Report("parallel for (empty, 64 items)", Bench::Measure(cycles, [] { ParallelFor(64, [](size_t) {}); }), 0, 0);
+
+	for (const auto& order : { kBGRA, kRGBA }) {
+		for (Int blockSize : { 64, 256, 1024 }) RunCanvas(cycles, 2048, blockSize, order);
+	}
+	// 8Kのキャンバス（キャッシュに乗らない大きさでのメモリ帯域）
+	for (const auto& order : { kBGRA, kRGBA }) RunCanvas(cycles, 8192, 256, order);
+	TerminateParallelFor();
+	return 0;
+}
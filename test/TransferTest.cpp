@@ -0,0 +1,159 @@
+/**
+ * @file TransferTest.cpp
+ * @author 青猫 (AonekoSS)
+ * @brief ブロック転送（Transfer）のテスト
+ * @note SIMD版の結果がスカラー版（元の実装）とビット単位で一致するか、並びと幅の組み合わせ全部で確認
+ */
+#include "pch.h"
+
+#include "SDPlugin.h"
+#include "FilterPlugIn.h"
+#include "Test.h"
+
+using namespace FilterPlugIn;
+
+/// ピクセルの並び
+struct Layout {
+	Int pixelBytes, r, g, b;
+};
+constexpr Layout kLayouts[] = {
+	{ 3, 0, 1, 2 }, // プラグインのRGB
+	{ 3, 2, 1, 0 },
+	{ 4, 2, 1, 0 }, // ホストのBGRA
+	{ 4, 0, 1, 2 }, // ホストのRGBA
+	{ 4, 1, 2, 3 }, // ホストのARGB
+};
+
+/// テスト用のバッファ（行末に余りを付けて、はみ出して書いたら分かるように）
+struct Buffer {
+	static constexpr Int kPadding = 37;
+	std::vector<uint8_t> bytes;
+	Block block;
+
+	Buffer(const Rect& rect, const Layout& layout, uint32_t seed, bool needOffset) {
+		const Int width = rect.right - rect.left, height = rect.bottom - rect.top;
+		const Int rowBytes = width * layout.pixelBytes + kPadding;
+		bytes.resize(static_cast<size_t>(rowBytes) * height);
+		for (auto& v : bytes) { seed = seed * 1664525 + 1013904223; v = static_cast<uint8_t>(seed >> 24); }
+		block = Block{ rect, bytes.data(), rowBytes, layout.pixelBytes, layout.r, layout.g, layout.b, needOffset };
+	}
+	/// 0か255が多め（アルファ用）
+	void binarize() {
+		for (auto& v : bytes) v = v < 64 ? 0 : v < 128 ? v : 255;
+	}
+};
+
+/// ピクセルのアドレス（FilterPlugIn.cppのaddressOffsetと同じ考え方）
+static uint8_t* At(const Block& block, const Rect& rect, Int x, Int y) {
+	const Rect& base = block.needOffset ? block.rect : rect;
+	return static_cast<uint8_t*>(block.address) + (y - base.top) * block.rowBytes + (x - base.left) * block.pixelBytes;
+}
+
+static Rect Intersect(const Rect& a, const Rect& b) {
+	return { std::max(a.left, b.left), std::max(a.top, b.top), std::min(a.right, b.right), std::min(a.bottom, b.bottom) };
+}
+
+/// スカラー版（SIMD化前の実装）
+static void ReferenceTransfer(const Block& dst, const Block& src, const Block* alpha, const Block* select) {
+	const auto rect = Intersect(dst.rect, src.rect);
+	for (Int y = rect.top; y < rect.bottom; ++y) {
+		for (Int x = rect.left; x < rect.right; ++x) {
+			auto d = At(dst, rect, x, y);
+			const auto s = At(src, rect, x, y);
+			if (alpha && !*At(*alpha, rect, x, y)) continue;
+			if (select) {
+				const int a = *At(*select, rect, x, y);
+				auto blend = [a](int dv, int sv) { return static_cast<uint8_t>(((sv - dv) * a) / 255 + dv); };
+				d[dst.r] = blend(d[dst.r], s[src.r]);
+				d[dst.g] = blend(d[dst.g], s[src.g]);
+				d[dst.b] = blend(d[dst.b], s[src.b]);
+			} else {
+				d[dst.r] = s[src.r];
+				d[dst.g] = s[src.g];
+				d[dst.b] = s[src.b];
+			}
+		}
+	}
+}
+
+/// 全部の組み合わせで比べる
+/// @param overloadArgs 0:アルファ無し 1:アルファ付き 2:アルファ＆選択マスク付き
+static void TestOverload(int overloadArgs) {
+	uint32_t seed = 1;
+	for (const auto& dstLayout : kLayouts) {
+		for (const auto& srcLayout : kLayouts) {
+			for (Int width : { 1, 3, 4, 5, 7, 8, 15, 16, 17, 21, 33, 64, 257 }) {
+				for (const bool srcOffset : { false, true }) {
+					// 転送元が画像全体（needOffset有り）の時は、転送先がその一部
+					const Rect dstRect{ 100, 50, 100 + width, 53 };
+					const Rect srcRect = srcOffset ? Rect{ 90, 40, 100 + width + 9, 60 } : dstRect;
+					Buffer expected(dstRect, dstLayout, ++seed, false), actual = expected;
+					actual.block.address = actual.bytes.data();
+					Buffer src(srcRect, srcLayout, ++seed, srcOffset);
+					Buffer alpha(dstRect, { 1, 0, 0, 0 }, ++seed, false);
+					Buffer select(dstRect, { 1, 0, 0, 0 }, ++seed, false);
+					alpha.binarize();
+					select.binarize();
+
+					switch (overloadArgs) {
+					case 0:
+						ReferenceTransfer(expected.block, src.block, nullptr, nullptr);
+						Transfer(actual.block, src.block);
+						break;
+					case 1:
+						ReferenceTransfer(expected.block, src.block, &alpha.block, nullptr);
+						Transfer(actual.block, src.block, alpha.block);
+						break;
+					default:
+						ReferenceTransfer(expected.block, src.block, &alpha.block, &select.block);
+						Transfer(actual.block, src.block, alpha.block, select.block);
+						break;
+					}
+					if (expected.bytes != actual.bytes) {
+						++Test::failures;
+						printf("Transfer(%d) mismatch: dst %d/%d%d%d src %d/%d%d%d width %d offset %d\n", overloadArgs,
+							static_cast<int>(dstLayout.pixelBytes), static_cast<int>(dstLayout.r), static_cast<int>(dstLayout.g), static_cast<int>(dstLayout.b),
+							static_cast<int>(srcLayout.pixelBytes), static_cast<int>(srcLayout.r), static_cast<int>(srcLayout.g), static_cast<int>(srcLayout.b),
+							static_cast<int>(width), srcOffset);
+					}
+				}
+			}
+		}
+	}
+}
+
+/// ブレンドの端の値（/255の丸めが全部の組み合わせで一致するか）
+static void TestBlendExhaustive() {
+	const Rect rect{ 0, 0, 256, 1 };
+	const Layout rgba{ 4, 0, 1, 2 };
+	for (int a = 0; a < 256; ++a) {
+		Buffer expected(rect, rgba, 1, false), actual = expected;
+		actual.block.address = actual.bytes.data();
+		Buffer src(rect, rgba, 2, false);
+		Buffer alpha(rect, { 1, 0, 0, 0 }, 3, false);
+		Buffer select(rect, { 1, 0, 0, 0 }, 4, false);
+		// 転送先は0～255、転送元はその逆順、アルファは全部不透明、選択は一定
+		for (Int x = 0; x < 256; ++x) {
+			for (int c = 0; c < 3; ++c) {
+				expected.bytes[x * 4 + c] = actual.bytes[x * 4 + c] = static_cast<uint8_t>(x);
+				src.bytes[x * 4 + c] = static_cast<uint8_t>(255 - ((x * 7 + c * 85) & 255));
+			}
+			alpha.bytes[x] = 255;
+			select.bytes[x] = static_cast<uint8_t>(a);
+		}
+		ReferenceTransfer(expected.block, src.block, &alpha.block, &select.block);
+		Transfer(actual.block, src.block, alpha.block, select.block);
+		if (expected.bytes != actual.bytes) {
+			++Test::failures;
+			printf("blend mismatch: select %d\n", a);
+		}
+	}
+}
+
+int main() {
+	TestOverload(0);
+	TestOverload(1);
+	TestOverload(2);
+	TestBlendExhaustive();
+	return Test::Result("TransferTest");
+}